@@ -0,0 +1,523 @@
+#define ojTest
+#define noMain
+#include "src/game.cpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <random>
+
+// every heap allocation of the process goes through here so runs can be measured
+// kept out of line: once inlined, gcc pairs the malloc in new with the free in delete and warns about a mismatch
+#ifdef __GNUC__
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+
+atomic<long long> n_allocs(0);
+
+BENCH_NOINLINE void *operator new(size_t size)
+{
+    n_allocs.fetch_add(1, memory_order_relaxed);
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw bad_alloc();
+}
+
+BENCH_NOINLINE void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+BENCH_NOINLINE void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+BENCH_NOINLINE void operator delete[](void *p) noexcept
+{
+    operator delete(p);
+}
+
+BENCH_NOINLINE void operator delete(void *p, size_t) noexcept
+{
+    operator delete(p);
+}
+
+BENCH_NOINLINE void operator delete[](void *p, size_t) noexcept
+{
+    operator delete(p);
+}
+
+struct BenchCase
+{
+    string name;
+    GameInfo info;
+    vector<string> codes;
+};
+
+// one line of json per case, so results can be diffed between versions
+struct BenchResult
+{
+    long long runs = 0;
+    long long steps = 0;
+    double seconds = 0;
+    long long allocs = 0;
+    double p50_us = 0;
+    double p99_us = 0;
+    string result;
+};
+
+vector<string> splitCodes(const string &text)
+{
+    vector<string> codes;
+    const char *p = text.data();
+    const char *e = p + text.size();
+    const char *lb, *le;
+    while (nextLine(p, e, lb, le))
+        codes.push_back(string(lb, le));
+    return codes;
+}
+
+// a shipped level with its reference answer from src/
+bool shippedCase(int level, BenchCase &c)
+{
+    c.name = "ans" + to_string(level);
+    c.info = levelInfo[level - 1];
+    Game game(c.info.title, c.info.in, c.info.available_command, c.info.n_playground, c.info.expected_out);
+    if (!game.importCode("src/ans" + to_string(level) + ".txt"))
+        return false;
+    c.codes = game.codes;
+    return true;
+}
+
+// inbox copied straight to outbox, stresses the inbox cursor and the output check
+BenchCase longInboxCase(int n)
+{
+    BenchCase c;
+    c.name = "long_inbox_" + to_string(n);
+    c.info.title = c.name;
+    c.info.available_command = {CommandId::inbox, CommandId::outbox, CommandId::jump};
+    for (int i = 0; i < n; i++)
+        c.info.in.push_back(i % 199 - 99);
+    c.info.expected_out = c.info.in;
+    c.codes = splitCodes("inbox\noutbox\njump 1\n");
+    return c;
+}
+
+// counts every input down to zero, almost all steps are jumps
+BenchCase jumpLoopCase(int n, int depth)
+{
+    BenchCase c;
+    c.name = "jump_loop_" + to_string(n) + "x" + to_string(depth);
+    c.info.title = c.name;
+    c.info.n_playground = 2;
+    c.info.available_command = {CommandId::inbox, CommandId::outbox, CommandId::sub, CommandId::copyto,
+                                CommandId::copyfrom, CommandId::jump, CommandId::jumpifzero};
+    c.info.in.push_back(1);
+    for (int i = 0; i < n; i++)
+    {
+        c.info.in.push_back(depth);
+        c.info.expected_out.push_back(0);
+    }
+    c.codes = splitCodes("inbox\ncopyto 0\ninbox\ncopyto 1\ncopyfrom 1\njumpifzero 10\nsub 0\n"
+                         "copyto 1\njump 5\noutbox\njump 3\n");
+    return c;
+}
+
+// every input is passed through all playground slots before it is sent out
+BenchCase copyTrafficCase(int n)
+{
+    const int n_slot = 8;
+    BenchCase c;
+    c.name = "copy_traffic_" + to_string(n);
+    c.info.title = c.name;
+    c.info.n_playground = n_slot;
+    c.info.available_command = {CommandId::inbox, CommandId::outbox, CommandId::copyto, CommandId::copyfrom, CommandId::jump};
+    for (int i = 0; i < n; i++)
+        c.info.in.push_back(i % 97);
+    c.info.expected_out = c.info.in;
+    string text = "inbox\n";
+    for (int i = 0; i < n_slot; i++)
+        text += "copyto " + to_string(i) + "\ncopyfrom " + to_string(i) + "\n";
+    text += "outbox\njump 1\n";
+    c.codes = splitCodes(text);
+    return c;
+}
+
+double percentile(vector<double> &samples, double q)
+{
+    if (samples.empty())
+        return 0;
+    size_t k = min(samples.size() - 1, (size_t)(q * samples.size()));
+    nth_element(samples.begin(), samples.begin() + k, samples.end());
+    return samples[k];
+}
+
+// the engines that grade submissions, these must not allocate once warmed up
+bool isGradingEngine(const string &engine)
+{
+    return engine == "grader" || engine == "jit";
+}
+
+// one submission on an engine: "interp" builds a Game, "grader" and "jit" run in the thread's arena
+Grader::Verdict runOnce(const BenchCase &c, const string &engine)
+{
+    if (isGradingEngine(engine))
+        return Grader(c.info).run(c.codes, engine == "jit");
+    Game game(c.info.title, c.info.in, c.info.available_command, c.info.n_playground, c.info.expected_out, c.info.max_steps);
+    game.codes = c.codes;
+    game.runCode(false);
+    return {game.prevResult, game.step_used, game.current_line};
+}
+
+// judge the case over and over for at least min_seconds, each run is one submission
+BenchResult runCase(const BenchCase &c, double min_seconds, const string &engine)
+{
+    using clock = chrono::steady_clock;
+    BenchResult r;
+    vector<double> latency;
+    latency.reserve(1 << 16);
+    // one run before counting, so buffers that are kept between runs are in place: allocs_per_run is the steady state
+    Grader::Verdict verdict = runOnce(c, engine);
+    r.result = resultText(verdict.result, verdict.current_line);
+    long long allocs_before = n_allocs.load();
+    clock::time_point start = clock::now();
+    while (r.seconds < min_seconds || r.runs < 3)
+    {
+        clock::time_point t0 = clock::now();
+        verdict = runOnce(c, engine);
+        clock::time_point t1 = clock::now();
+
+        r.runs++;
+        r.steps += verdict.step_used;
+        if (latency.size() < latency.capacity())
+            latency.push_back(chrono::duration<double, micro>(t1 - t0).count());
+        r.seconds = chrono::duration<double>(t1 - start).count();
+    }
+    // the latency buffer is reserved before counting, so only the runs themselves are counted
+    r.allocs = n_allocs.load() - allocs_before;
+    r.p50_us = percentile(latency, 0.50);
+    r.p99_us = percentile(latency, 0.99);
+    return r;
+}
+
+// everything a run reports, compared between the interpreter and the jit
+string runSummary(const GameInfo &info, const vector<string> &codes, long long max_steps, bool jit)
+{
+    Game game(info.title, info.in, info.available_command, info.n_playground, info.expected_out, max_steps);
+    game.codes = codes;
+    game.jit = jit;
+    game.runCode(false);
+    string text = judgeResult(game) + " steps=" + to_string(game.step_used) + " line=" + to_string(game.current_line) + " out=";
+    for (int v : game.current_out)
+        text += to_string(v) + ",";
+    text += " hand=" + (game.box_taken.isEmpty ? string("-") : to_string(game.box_taken.data)) + " slots=";
+    for (Box &box : game.playground_boxes)
+        text += (box.isEmpty ? string("-") : to_string(box.data)) + ",";
+    return text;
+}
+
+// the verdict of the grader, with or without the jit
+string gradeSummary(GameInfo info, const vector<string> &codes, long long max_steps, bool jit)
+{
+    info.max_steps = max_steps;
+    Grader::Verdict verdict = Grader(info).run(codes, jit);
+    return resultText(verdict.result, verdict.current_line) + " steps=" + to_string(verdict.step_used) + " line=" +
+           to_string(verdict.current_line);
+}
+
+// one program on both backends, both in a Game and in the grader
+bool jitAgrees(const GameInfo &info, const vector<string> &codes, long long max_steps)
+{
+    return runSummary(info, codes, max_steps, true) == runSummary(info, codes, max_steps, false) &&
+           gradeSummary(info, codes, max_steps, true) == gradeSummary(info, codes, max_steps, false);
+}
+
+// random program over the level's commands, arguments are sometimes out of range to hit the error paths
+vector<string> randomProgram(const GameInfo &info, mt19937 &rng)
+{
+    vector<string> codes;
+    int n = 1 + rng() % 12;
+    vector<CommandId> commands = info.available_command;
+    commands.push_back(CommandId::jump);
+    for (int i = 0; i < n; i++)
+    {
+        CommandId id = commands[rng() % commands.size()];
+        string line = toStr(id);
+        if (id == CommandId::jump || id == CommandId::jumpifzero)
+            line += " " + to_string((int)(rng() % (n + 1)) + (rng() % 8 == 0 ? 1 : 0));
+        else if (id >= CommandId::add)
+            line += " " + to_string((int)(rng() % (info.n_playground + 1)));
+        codes.push_back(line);
+    }
+    return codes;
+}
+
+// the jit must agree with the interpreter on every case and on random programs
+// @return number of programs that disagree
+int checkJit(const vector<BenchCase> &cases, int n_random)
+{
+    int mismatches = 0;
+    for (const BenchCase &c : cases)
+    {
+        if (!jitAgrees(c.info, c.codes, c.info.max_steps))
+        {
+            cerr << "jit mismatch on " << c.name << endl;
+            mismatches++;
+        }
+    }
+    mt19937 rng(12345);
+    for (int i = 0; i < n_random; i++)
+    {
+        const GameInfo &info = levelInfo[rng() % levelInfo.size()];
+        vector<string> codes = randomProgram(info, rng);
+        long long max_steps = rng() % 4 == 0 ? 1 + rng() % 50 : 100000;
+        if (!jitAgrees(info, codes, max_steps))
+        {
+            cerr << "jit mismatch on random program:" << endl;
+            for (const string &code : codes)
+                cerr << "  " << code << endl;
+            mismatches++;
+        }
+    }
+    printf("{\"check\":\"jit\",\"programs\":%d,\"mismatches\":%d}\n", (int)cases.size() + n_random, mismatches);
+    fflush(stdout);
+    return mismatches;
+}
+
+// decode codes the way Game::compileCode does
+vector<Instruction> compileCodes(const GameInfo &info, const vector<string> &codes)
+{
+    vector<Instruction> program;
+    for (const string &code : codes)
+        program.push_back(compileLine(code.data(), code.data() + code.size(), info.available_command, info.n_playground, codes.size()));
+    return program;
+}
+
+// expected outputs of a shipped level for any inbox, so random inboxes can be judged
+vector<int> levelOracle(int level, const vector<int> &in)
+{
+    vector<int> out;
+    for (int i = 0; i + 1 < in.size() && level > 1; i += 2)
+    {
+        if (level == 2)
+        {
+            out.push_back(in[i] - in[i + 1]);
+            out.push_back(in[i + 1] - in[i]);
+        }
+        else if (in[i] == in[i + 1])
+            out.push_back(in[i]);
+    }
+    return level == 1 ? in : out;
+}
+
+// random inbox of pairs with small values, so the twins of level 3 show up often
+vector<int> randomInbox(mt19937 &rng)
+{
+    vector<int> in(2 * (rng() % 8));
+    for (int &v : in)
+        v = (int)(rng() % 19) - 9;
+    return in;
+}
+
+// the same fields as runSummary, for one instance of the lane engine
+string laneSummary(const LaneEngine::LaneResult &r)
+{
+    static const char *names[] = {"Idle", "Success", "Fail", "Error", "TLE"};
+    string text = string(names[(int)r.result]) + " steps=" + to_string(r.step_used) + " line=" + to_string(r.current_line) +
+                  " loop=" + to_string(r.loop_detected) + " fail=" + to_string(r.fail_index) + ":" + to_string(r.fail_value) + " out=";
+    for (int v : r.out)
+        text += to_string(v) + ",";
+    return text;
+}
+
+string gameSummary(const Game &game)
+{
+    static const char *names[] = {"Idle", "Success", "Fail", "Error", "TLE"};
+    string text = string(names[(int)game.prevResult]) + " steps=" + to_string(game.step_used) + " line=" + to_string(game.current_line) +
+                  " loop=" + to_string(game.loop_detected) + " fail=" + to_string(game.fail_index) + ":" +
+                  to_string(game.prevResult == Result::failed ? game.fail_value : 0) + " out=";
+    for (int v : game.current_out)
+        text += to_string(v) + ",";
+    return text;
+}
+
+// the lane engine must agree with Game on random programs over random inboxes
+// @return number of instances that disagree
+int checkLanes(int n_random)
+{
+    int mismatches = 0, n_instances = 0;
+    mt19937 rng(54321);
+    for (int i = 0; i < n_random; i++)
+    {
+        int level = 1 + rng() % levelInfo.size();
+        const GameInfo &info = levelInfo[level - 1];
+        vector<string> codes = randomProgram(info, rng);
+        long long max_steps = rng() % 4 == 0 ? 1 + rng() % 50 : 100000;
+        vector<vector<int>> inputs(1 + rng() % 20), expected;
+        for (vector<int> &in : inputs)
+        {
+            in = randomInbox(rng);
+            expected.push_back(levelOracle(level, in));
+            if (rng() % 4 == 0 && !expected.back().empty())
+                expected.back()[rng() % expected.back().size()]++;
+        }
+        vector<LaneEngine::LaneResult> results = LaneEngine(compileCodes(info, codes), info.n_playground, max_steps).run(inputs, expected);
+        for (int k = 0; k < inputs.size(); k++)
+        {
+            Game game(info.title, inputs[k], info.available_command, info.n_playground, expected[k], max_steps);
+            game.codes = codes;
+            game.runCode(false);
+            n_instances++;
+            if (laneSummary(results[k]) != gameSummary(game))
+            {
+                if (mismatches++ < 5)
+                    cerr << "lane mismatch: " << laneSummary(results[k]) << " vs " << gameSummary(game) << endl;
+            }
+        }
+    }
+    printf("{\"check\":\"lanes\",\"instances\":%d,\"mismatches\":%d}\n", n_instances, mismatches);
+    fflush(stdout);
+    return mismatches;
+}
+
+// the reference solutions compiled into the static_asserts must stay byte-identical to src/ans1-4.txt
+// @return number of levels whose file is missing or differs
+int checkReferenceSolutions()
+{
+    int mismatches = 0;
+    for (int i = 0; i < N_LEVEL; i++)
+    {
+        string path = "src/ans" + to_string(i + 1) + ".txt";
+        ifstream in(path, ios::binary);
+        string text((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        if (!in.is_open() || text != REFERENCE_SOLUTION[i])
+        {
+            cerr << "REFERENCE_SOLUTION[" << i << "] differs from " << path << endl;
+            mismatches++;
+        }
+    }
+    printf("{\"check\":\"reference\",\"levels\":%d,\"mismatches\":%d}\n", N_LEVEL, mismatches);
+    fflush(stdout);
+    return mismatches;
+}
+
+// a reference solution judged on many random inboxes, one instance at a time and with the lane engine
+void runFuzzCase(const BenchCase &c, int level, int n_inboxes, double min_seconds)
+{
+    using clock = chrono::steady_clock;
+    mt19937 rng(level);
+    vector<vector<int>> inputs(n_inboxes), expected;
+    for (vector<int> &in : inputs)
+    {
+        in = randomInbox(rng);
+        expected.push_back(levelOracle(level, in));
+    }
+    vector<Instruction> program = compileCodes(c.info, c.codes);
+    for (int lanes = 0; lanes < 2; lanes++)
+    {
+        long long runs = 0, steps = 0;
+        double seconds = 0;
+        clock::time_point start = clock::now();
+        while (seconds < min_seconds || runs == 0)
+        {
+            if (lanes)
+            {
+                for (const LaneEngine::LaneResult &r : LaneEngine(program, c.info.n_playground, c.info.max_steps).run(inputs, expected))
+                    steps += r.step_used;
+            }
+            else
+            {
+                for (int k = 0; k < n_inboxes; k++)
+                {
+                    Game game(c.info.title, inputs[k], c.info.available_command, c.info.n_playground, expected[k], c.info.max_steps);
+                    game.codes = c.codes;
+                    game.runCode(false);
+                    steps += game.step_used;
+                }
+            }
+            runs += n_inboxes;
+            seconds = chrono::duration<double>(clock::now() - start).count();
+        }
+        printf("{\"case\":\"fuzz_%s_%d\",\"engine\":\"%s\",\"runs\":%lld,\"steps_per_run\":%.1f,\"ns_per_step\":%.3f,"
+               "\"us_per_run\":%.3f}\n",
+               c.name.c_str(), n_inboxes, lanes ? "lanes" : "interp", runs, (double)steps / runs, seconds * 1e9 / steps, seconds * 1e6 / runs);
+        fflush(stdout);
+    }
+}
+
+// usage: bench [seconds per case], run from the repository root, fails if a grading engine allocates in steady state
+//        bench --check compares the lane engine and the jit with Game on random programs instead, and the compiled-in
+//        reference solutions with src/ansN.txt, and fails on a mismatch
+// checkers generated by the ojTest build with --emit-cpp print the same json lines with engine "aot"
+int main(int argc, char *argv[])
+{
+    initGameInfo();
+    bool check = argc > 1 && string(argv[1]) == "--check";
+    double min_seconds = 1;
+    if (argc > 1 && !check)
+        min_seconds = atof(argv[1]);
+
+    vector<BenchCase> cases;
+    for (int level = 1; level <= levelInfo.size(); level++)
+    {
+        BenchCase c;
+        if (shippedCase(level, c))
+            cases.push_back(c);
+        else
+            cerr << "cannot load src/ans" << level << ".txt" << endl;
+    }
+    cases.push_back(longInboxCase(1000000));
+    cases.push_back(jumpLoopCase(1000, 1000));
+    cases.push_back(copyTrafficCase(100000));
+
+    if (check)
+    {
+        int mismatches = checkReferenceSolutions();
+        mismatches += checkLanes(5000);
+#ifdef hasJit
+        mismatches += checkJit(cases, 20000);
+#endif
+        return mismatches > 0 ? 1 : 0;
+    }
+
+    vector<string> engines = {"interp", "grader"};
+#ifdef hasJit
+    engines.push_back("jit");
+#endif
+
+    int allocating = 0;
+    for (const BenchCase &c : cases)
+    {
+        for (const string &engine : engines)
+        {
+            BenchResult r = runCase(c, min_seconds, engine);
+            if (isGradingEngine(engine) && r.allocs > 0)
+            {
+                cerr << engine << " allocates " << (double)r.allocs / r.runs << " times per run on " << c.name << endl;
+                allocating++;
+            }
+            double steps_per_run = (double)r.steps / r.runs;
+            double ns_per_step = r.steps > 0 ? r.seconds * 1e9 / r.steps : 0;
+            double steps_per_sec = r.seconds > 0 ? r.steps / r.seconds : 0;
+            printf("{\"case\":\"%s\",\"engine\":\"%s\",\"result\":\"%s\",\"runs\":%lld,\"steps_per_run\":%.0f,"
+                   "\"steps_per_sec\":%.0f,\"ns_per_step\":%.3f,\"allocs_per_run\":%.2f,"
+                   "\"p50_us\":%.3f,\"p99_us\":%.3f}\n",
+                   c.name.c_str(), engine.c_str(), r.result.c_str(), r.runs, steps_per_run, steps_per_sec, ns_per_step,
+                   (double)r.allocs / r.runs, r.p50_us, r.p99_us);
+            fflush(stdout);
+        }
+    }
+    for (int level = 2; level <= 3; level++)
+    {
+        // a missing answer file is skipped above, so find the case by name rather than by position
+        string name = "ans" + to_string(level);
+        auto it = find_if(cases.begin(), cases.end(), [&](const BenchCase &c) { return c.name == name; });
+        if (it != cases.end())
+            runFuzzCase(*it, level, 4096, min_seconds);
+    }
+    return allocating > 0 ? 1 : 0;
+}
@@ -0,0 +1,484 @@
+#define ojTest
+#define noMain
+#include "src/game.cpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <thread>
+
+#ifdef isWindows
+#define popen _popen
+#define pclose _pclose
+#endif
+
+// one in this many cases is also translated by generateCpp and built, which takes far longer than running it
+const int COMPILED_SAMPLE = 16384;
+
+// one fuzz case: a level with a random inbox, expected output and program text
+struct FuzzCase
+{
+    GameInfo info;
+    vector<string> codes;
+    // whether the case is also checked with the generated checker
+    bool compiled;
+};
+
+// what an engine reports: result text and steps in the summary, the line and the outputs apart since not every engine keeps them
+struct Outcome
+{
+    string engine;
+    string summary;
+    bool has_line;
+    int line;
+    bool has_out;
+    string out;
+
+    string text() const
+    {
+        return summary + (has_line ? " line=" + to_string(line) : "") + (has_out ? " out=" + out : "");
+    }
+};
+
+string outputText(const vector<int> &out)
+{
+    string text;
+    for (int v : out)
+        text += to_string(v) + ",";
+    return text;
+}
+
+Outcome gameOutcome(const string &engine, const Game &game)
+{
+    return {engine, judgeResult(game) + " steps=" + to_string(game.step_used), true, game.current_line, true, outputText(game.current_out)};
+}
+
+Outcome verdictOutcome(const string &engine, const Grader::Verdict &verdict)
+{
+    return {engine, resultText(verdict.result, verdict.current_line) + " steps=" + to_string(verdict.step_used), true, verdict.current_line,
+            false, ""};
+}
+
+// the machine state between two steps as the user sees it, compared between stepping, replay and the debugger
+string stateText(const Game &game)
+{
+    string text = "step=" + to_string(game.step_used) + " line=" + to_string(game.current_line) +
+                  " hand=" + (game.box_taken.isEmpty ? string("-") : to_string(game.box_taken.data)) + " in=" + to_string(game.in_pos) + " slots=";
+    for (const Box &box : game.playground_boxes)
+        text += (box.isEmpty ? string("-") : to_string(box.data)) + ",";
+    return text + " out=" + outputText(game.current_out);
+}
+
+// a fresh game for the case, the same way judge builds one
+Game newGame(const FuzzCase &c)
+{
+    Game game(c.info.title, c.info.in, c.info.available_command, c.info.n_playground, c.info.expected_out, c.info.max_steps);
+    game.codes = c.codes;
+    return game;
+}
+
+// the reference: one instruction at a time through the handle* functions
+Game steppedGame(const FuzzCase &c)
+{
+    Game game = newGame(c);
+    game.beginCode();
+    if (game.program.empty())
+        game.prevResult = Result::error;
+    else
+    {
+        bool done = false, error = false, timed_out = false;
+        while (game.stepProgram(false, game.max_steps, done, error, timed_out))
+            ;
+        game.finishRun(error, timed_out);
+    }
+    return game;
+}
+
+// the state of a stepped game after each of the given numbers of steps, which must be ascending
+// at n_steps, the length of the whole run, the game is stepped until it halts so the state includes the final result
+vector<string> steppedStates(const FuzzCase &c, const vector<long long> &targets, long long n_steps)
+{
+    Game game = newGame(c);
+    game.beginCode();
+    bool running = !game.program.empty();
+    bool done = false, error = false, timed_out = false;
+    vector<string> states;
+    for (long long target : targets)
+    {
+        while (running && (game.step_used < target || target >= n_steps))
+        {
+            if (!game.stepProgram(false, game.max_steps, done, error, timed_out))
+            {
+                game.finishRun(error, timed_out);
+                running = false;
+            }
+        }
+        states.push_back(stateText(game));
+    }
+    return states;
+}
+
+// playback: the traced run, sought back and forth to random steps, must show the stepped game's state at each of them
+Outcome runReplay(const FuzzCase &c)
+{
+    Game game = newGame(c);
+    game.optimizing = true;
+    game.tracing = true;
+    game.runCode(false);
+    const Trace &trace = game.trace;
+    long long n_steps = trace.steps.size();
+
+    // seeded from the case, so minimize sees the same seeks again
+    mt19937 rng(n_steps * 7919 + c.codes.size());
+    vector<long long> targets = {0, n_steps};
+    for (int i = 0; i < 6; i++)
+        targets.push_back(rng() % (n_steps + 1));
+    vector<long long> sorted = targets;
+    sort(sorted.begin(), sorted.end());
+    sorted.erase(unique(sorted.begin(), sorted.end()), sorted.end());
+    vector<string> expected = steppedStates(c, sorted, n_steps);
+
+    string mismatch;
+    game.resetState();
+    shuffle(targets.begin(), targets.end(), rng);
+    for (long long target : targets)
+    {
+        game.seekTrace(target);
+        const string &state = expected[lower_bound(sorted.begin(), sorted.end(), target) - sorted.begin()];
+        if (mismatch.empty() && stateText(game) != state)
+            mismatch = " seek " + to_string(target) + " shows " + stateText(game) + " instead of " + state;
+    }
+    return {"replay", resultText(trace.result, trace.final_line) + " steps=" + to_string(n_steps) + mismatch, true, trace.final_line, true,
+            outputText(trace.outputs)};
+}
+
+// the debugger: stepping forward past some step and back to it must restore the state there, and resuming must end as before
+Outcome runDebugger(const FuzzCase &c, long long n_steps)
+{
+    Game game = newGame(c);
+    Debugger debugger(game);
+    string mismatch;
+    if (debugger.start() && n_steps > 0)
+    {
+        // seeded from the case, so minimize sees the same steps again
+        mt19937 rng(n_steps * 104729 + c.codes.size());
+        long long at = rng() % n_steps;
+        while (game.step_used < at && !debugger.halted)
+            debugger.forward(false);
+        string state = stateText(game);
+        for (long long n = 1 + rng() % 600; n > 0 && !debugger.halted; n--)
+            debugger.forward(false);
+        debugger.back(game.step_used - at);
+        if (stateText(game) != state)
+            mismatch = " back to " + to_string(at) + " shows " + stateText(game) + " instead of " + state;
+    }
+    while (!debugger.halted)
+        debugger.forward(false);
+    Outcome outcome = gameOutcome("back", game);
+    outcome.summary += mismatch;
+    return outcome;
+}
+
+// the checker generated by --emit-cpp, built with the system compiler ($CXX or c++) and run once with the bench switch for its steps
+Outcome runCompiled(const FuzzCase &c)
+{
+    static atomic<int> n_built(0);
+    string base = "fuzz_aot_" + to_string(n_built.fetch_add(1));
+    string source = base + ".cpp";
+#ifdef isWindows
+    string binary = base + ".exe";
+    string command = binary + " 0";
+#else
+    string binary = base;
+    string command = "./" + binary + " 0";
+#endif
+    Game game = newGame(c);
+    game.beginCode();
+    {
+        ofstream out(source);
+        out << generateCpp(c.info, game.program, game.codes, base);
+    }
+    const char *cxx = getenv("CXX");
+    string build = string(cxx != nullptr ? cxx : "c++") + " -O1 -w -o " + binary + " " + source;
+    string output;
+    if (system(build.c_str()) == 0)
+    {
+        if (FILE *pipe = popen(command.c_str(), "r"))
+        {
+            char buffer[512];
+            while (fgets(buffer, sizeof(buffer), pipe) != nullptr)
+                output += buffer;
+            pclose(pipe);
+        }
+    }
+    remove(source.c_str());
+    remove(binary.c_str());
+
+    // {"case":...,"result":"<text>","runs":...,"steps_per_run":<steps>,...}
+    size_t result = output.find("\"result\":\"");
+    size_t steps = output.find("\"steps_per_run\":");
+    if (result == string::npos || steps == string::npos)
+        return {"aot", "no output from " + build, false, 0, false, ""};
+    result += 10;
+    steps += 16;
+    return {"aot", output.substr(result, output.find('"', result) - result) + " steps=" + output.substr(steps, output.find(',', steps) - steps),
+            false, 0, false, ""};
+}
+
+// the headless runCode path with its switches set
+Outcome runHeadless(const string &engine, const FuzzCase &c, bool optimizing, bool profiling, bool tracing, bool jit)
+{
+    Game game = newGame(c);
+    game.optimizing = optimizing;
+    game.profiling = profiling;
+    game.tracing = tracing;
+    game.jit = jit;
+    game.runCode(false);
+    return gameOutcome(engine, game);
+}
+
+vector<Outcome> runEngines(const FuzzCase &c)
+{
+    vector<Outcome> outcomes;
+    Game stepped = steppedGame(c);
+    outcomes.push_back(gameOutcome("step", stepped));
+    outcomes.push_back(runHeadless("fast", c, false, false, false, false));
+    outcomes.push_back(runHeadless("fused", c, true, false, false, false));
+    outcomes.push_back(runHeadless("profile", c, true, true, false, false));
+    outcomes.push_back(runHeadless("trace", c, true, false, true, false));
+#ifdef hasJit
+    outcomes.push_back(runHeadless("jit", c, true, false, false, true));
+#endif
+
+    outcomes.push_back(runReplay(c));
+    outcomes.push_back(runDebugger(c, stepped.step_used));
+
+    // the grader keeps no outputs either
+    outcomes.push_back(verdictOutcome("grader", Grader(c.info).run(c.codes)));
+#ifdef hasJit
+    outcomes.push_back(verdictOutcome("grader_jit", Grader(c.info).run(c.codes, true)));
+#endif
+
+    Game game = newGame(c);
+    game.beginCode();
+    const vector<Instruction> &program = game.program;
+    LaneEngine::LaneResult lane = LaneEngine(program, c.info.n_playground, c.info.max_steps).run({c.info.in}, {c.info.expected_out})[0];
+    outcomes.push_back({"lanes", resultText(lane.result, lane.current_line) + " steps=" + to_string(lane.step_used), true, lane.current_line,
+                        true, outputText(lane.out)});
+
+    // constRun does not keep the outputs, compare everything before them
+    ConstLevel level;
+    ConstProgram const_program;
+    if (toConstLevel(c.info, level) && toConstProgram(program, const_program))
+    {
+        ConstResult r = constRun(level, const_program, c.info.max_steps);
+        outcomes.push_back({"const", resultText(r.result, r.line) + " steps=" + to_string(r.steps), true, r.line, false, ""});
+    }
+
+    // the generated checker reports neither the line nor the outputs
+    if (c.compiled)
+        outcomes.push_back(runCompiled(c));
+    return outcomes;
+}
+
+// @return the engines that disagree with the reference, empty if all agree
+string divergence(const FuzzCase &c)
+{
+    vector<Outcome> outcomes = runEngines(c);
+    const Outcome &reference = outcomes[0];
+    string engines;
+    for (const Outcome &o : outcomes)
+    {
+        if (o.summary != reference.summary || (o.has_line && o.line != reference.line) || (o.has_out && o.out != reference.out))
+            engines += (engines.empty() ? "" : ",") + o.engine;
+    }
+    return engines;
+}
+
+// a line of program text, mostly valid for the level and sometimes broken in one of the ways a user can break it
+string randomLine(const GameInfo &info, int n_code, mt19937 &rng)
+{
+    static const char *noise[] = {"", "   ", "jump", "copyto", "inbox 1", "outbox x", "add -1", "sub 1 2", "hello", "jumpifzero +2", "\tcopyfrom  0 "};
+    if (rng() % 16 == 0)
+        return noise[rng() % (sizeof(noise) / sizeof(noise[0]))];
+    CommandId id = (CommandId)(rng() % 8);
+    if (rng() % 8 != 0 && find(info.available_command.begin(), info.available_command.end(), id) == info.available_command.end())
+        id = info.available_command[rng() % info.available_command.size()];
+    string line = toStr(id);
+    if (id == CommandId::jump || id == CommandId::jumpifzero)
+        line += " " + to_string((int)(rng() % (n_code + 2)));
+    else if (id >= CommandId::add)
+        line += " " + to_string((int)(rng() % (info.n_playground + 2)) - (rng() % 16 == 0 ? 1 : 0));
+    return line;
+}
+
+// the outputs the program produces on its own, found by growing the expected output one mismatch at a time
+vector<int> selfExpected(FuzzCase c)
+{
+    c.info.expected_out.clear();
+    for (int round = 0; round < 16; round++)
+    {
+        Game game = newGame(c);
+        game.runCode(false);
+        if (game.prevResult != Result::failed || game.fail_index < 0 || game.fail_index >= game.current_out.size())
+            break;
+        c.info.expected_out.push_back(game.current_out[game.fail_index]);
+    }
+    return c.info.expected_out;
+}
+
+FuzzCase randomCase(mt19937 &rng)
+{
+    FuzzCase c;
+    c.info = levelInfo[rng() % levelInfo.size()];
+    c.compiled = rng() % COMPILED_SAMPLE == 0;
+    if (rng() % 2)
+    {
+        c.info.in.resize(rng() % 12);
+        for (int &v : c.info.in)
+            v = (int)(rng() % 19) - 9;
+    }
+    // empty programs included, every engine must report them as an error on line 1
+    int n_code = rng() % 13;
+    for (int i = 0; i < n_code; i++)
+        c.codes.push_back(randomLine(c.info, n_code, rng));
+    c.info.max_steps = rng() % 4 == 0 ? 1 + rng() % 60 : 5000;
+    switch (rng() % 3)
+    {
+    case 0:
+        break; // the level's own expected output
+    case 1:
+        c.info.expected_out = selfExpected(c);
+        break;
+    default:
+        c.info.expected_out = selfExpected(c);
+        if (!c.info.expected_out.empty())
+            c.info.expected_out[rng() % c.info.expected_out.size()] += 1;
+        break;
+    }
+    return c;
+}
+
+// renumber jump targets after line `removed` (1-based) was deleted
+vector<string> removeLine(const vector<string> &codes, int removed)
+{
+    vector<string> result;
+    for (int i = 0; i < codes.size(); i++)
+    {
+        if (i + 1 == removed)
+            continue;
+        Instruction command;
+        const char *b = codes[i].data();
+        if (decodeLine(b, b + codes[i].size(), command) && (command.id == CommandId::jump || command.id == CommandId::jumpifzero) &&
+            command.arg > removed)
+            result.push_back(toStr(command.id) + " " + to_string(command.arg - 1));
+        else
+            result.push_back(codes[i]);
+    }
+    return result;
+}
+
+// shrink a divergent case while it still diverges: drop lines, inbox values and expected values
+FuzzCase minimize(FuzzCase c)
+{
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int i = c.codes.size(); i >= 1 && c.codes.size() > 1; i--)
+        {
+            FuzzCase t = c;
+            t.codes = removeLine(c.codes, i);
+            if (!divergence(t).empty())
+            {
+                c = t;
+                changed = true;
+            }
+        }
+        for (int i = c.info.in.size() - 1; i >= 0; i--)
+        {
+            FuzzCase t = c;
+            t.info.in.erase(t.info.in.begin() + i);
+            if (!divergence(t).empty())
+            {
+                c = t;
+                changed = true;
+            }
+        }
+        for (int i = c.info.expected_out.size() - 1; i >= 0; i--)
+        {
+            FuzzCase t = c;
+            t.info.expected_out.erase(t.info.expected_out.begin() + i);
+            if (!divergence(t).empty())
+            {
+                c = t;
+                changed = true;
+            }
+        }
+    }
+    return c;
+}
+
+// the program in the importCode format, the rest of the case follows it since importCode stops after the program
+void writeReproducer(const string &path, const FuzzCase &c)
+{
+    ofstream out(path);
+    out << c.codes.size() << endl;
+    for (const string &code : c.codes)
+        out << code << endl;
+    out << "# level: " << c.info.title << endl;
+    out << "# in: " << outputText(c.info.in) << endl;
+    out << "# expected: " << outputText(c.info.expected_out) << endl;
+    out << "# max steps: " << c.info.max_steps << endl;
+    for (const Outcome &o : runEngines(c))
+        out << "# " << o.engine << ": " << o.text() << endl;
+}
+
+// usage: fuzz [seconds] [threads] [seed]
+// every divergent case is minimized and written to fuzz_<seed>_<thread>_<n>.txt
+// a sample of the cases builds its generated checker in the current directory, so a C++ compiler must be on the path
+int main(int argc, char *argv[])
+{
+    initGameInfo();
+    double seconds = argc > 1 ? atof(argv[1]) : 10;
+    int n_threads = argc > 2 ? stoi(argv[2]) : thread::hardware_concurrency();
+    unsigned seed = argc > 3 ? stoul(argv[3]) : 1;
+    n_threads = max(n_threads, 1);
+
+    atomic<long long> n_cases(0), n_divergent(0);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    auto worker = [&](int t)
+    {
+        mt19937 rng(seed * 1000003u + t);
+        int found = 0;
+        while (chrono::duration<double>(chrono::steady_clock::now() - start).count() < seconds)
+        {
+            for (int k = 0; k < 64; k++)
+            {
+                FuzzCase c = randomCase(rng);
+                n_cases.fetch_add(1, memory_order_relaxed);
+                string engines = divergence(c);
+                if (engines.empty())
+                    continue;
+                n_divergent.fetch_add(1, memory_order_relaxed);
+                if (found >= 10)
+                    continue;
+                string path = "fuzz_" + to_string(seed) + "_" + to_string(t) + "_" + to_string(found++) + ".txt";
+                writeReproducer(path, minimize(c));
+                cerr << engines << " diverge, reproducer in " << path << endl;
+            }
+        }
+    };
+    vector<thread> pool;
+    for (int t = 1; t < n_threads; t++)
+        pool.emplace_back(worker, t);
+    worker(0);
+    for (thread &th : pool)
+        th.join();
+
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    printf("{\"cases\":%lld,\"divergent\":%lld,\"threads\":%d,\"cases_per_sec_per_thread\":%.0f}\n", n_cases.load(), n_divergent.load(),
+           n_threads, n_cases.load() / elapsed / n_threads);
+    return n_divergent.load() > 0 ? 1 : 0;
+}
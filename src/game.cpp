@@ -1,38 +1,90 @@
 #include <iostream>
 #include <vector>
-#include <list>
+#include <array>
 #include <string>
 #include <algorithm>
 #include <fstream>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+#include <new>
 
 using namespace std;
 void initGameInfo();
 void hideCursor();
-void testing();
+void testing(string option);
+bool emitCpp(int level, string solution_path, string output_path);
+bool superoptimize(int level, int max_lines, long long step_limit);
+bool useLevelPack(const string &path, string &error);
+bool convertLevels(const string &from, const string &to);
+bool checkLevels(const string &path);
 void playGame();
 void loadFromDb();
 
 // 若测试代码逻辑正确性，请定义ojTest
 // #define ojTest
-// 若当前OS为windows，请定义isWindows
+// 当前OS为windows时定义isWindows，由编译器预定义的_WIN32判断，其余平台使用POSIX接口
+#ifdef _WIN32
 #define isWindows
+#endif
 
-const int STEP_DELAY = 500;     // 游戏动画单步延迟时长（ms）
-const string dbPath = "db.txt"; // 数据库文件地址
+const int STEP_DELAY = 500;            // 游戏动画单步延迟时长（ms）
+const int FRAME_DELAY = 50;            // 快速回放时每帧的间隔（ms）
+const long long MAX_STEPS = 10000000; // 关卡默认的最大执行步数
+const string dbPath = "db.txt";        // 数据库文件地址
+const string TRACE_PATH = "trace.hrmt"; // 回放时保存执行轨迹的文件地址
 
-int main()
+// 被其他文件包含时（如test.cpp），请定义noMain
+#ifndef noMain
+int main(int argc, char *argv[])
 {
     initGameInfo();
 
 #ifdef ojTest
-    testing();
+    // 关卡包：--levels <file>使以下各项使用该关卡包，--convert <builtin|file> <file>转换格式，--check-levels <file>检查内容
+    if (argc > 2 && string(argv[1]) == "--levels")
+    {
+        string error;
+        if (!useLevelPack(argv[2], error))
+        {
+            cerr << argv[2] << ": " << error << endl;
+            return 1;
+        }
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc > 3 && string(argv[1]) == "--convert")
+        return convertLevels(argv[2], argv[3]) ? 0 : 1;
+    if (argc > 2 && string(argv[1]) == "--check-levels")
+        return checkLevels(argv[2]) ? 0 : 1;
+    // 生成某关卡解答的独立C++程序
+    if (argc > 3 && string(argv[1]) == "--emit-cpp")
+        return emitCpp(atoi(argv[2]), argv[3], argc > 4 ? argv[4] : "") ? 0 : 1;
+    // 穷举搜索某关卡的最短与最快解答
+    if (argc > 2 && string(argv[1]) == "--search")
+        return superoptimize(atoi(argv[2]), argc > 3 ? atoi(argv[3]) : 6, argc > 4 ? atoll(argv[4]) : 10000) ? 0 : 1;
+    testing(argc > 1 ? argv[1] : "");
 #else
+    (void)argc;
+    (void)argv;
     loadFromDb();
     hideCursor();
     playGame();
 #endif
     return 0;
 }
+#endif
+
+#ifdef isWindows
+#include <windows.h>
+#include <conio.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
 
 #ifdef ojTest
 void delay(int ms) {}
@@ -66,6 +118,150 @@ void trim(string &s)
     s.erase(s.find_last_not_of(" ") + 1);
 }
 
+// 以只读方式将整个文件映射到内存，析构时解除映射
+class MappedFile
+{
+#ifdef isWindows
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#else
+    int fd = -1;
+#endif
+
+public:
+    const char *data = nullptr;
+    size_t size = 0;
+
+    MappedFile() {}
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool open(const string &path)
+    {
+        close();
+#ifdef isWindows
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file, &file_size))
+        {
+            close();
+            return false;
+        }
+        size = file_size.QuadPart;
+        if (size == 0)
+            return true;
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping != NULL)
+            data = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            close();
+            return false;
+        }
+        size = st.st_size;
+        if (size == 0)
+            return true;
+        void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED)
+        {
+            data = (const char *)p;
+            madvise(p, size, MADV_SEQUENTIAL);
+        }
+#endif
+        if (data == nullptr)
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+#ifdef isWindows
+        if (data != nullptr)
+            UnmapViewOfFile(data);
+        if (mapping != NULL)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        mapping = NULL;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data != nullptr)
+            munmap((void *)data, size);
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+    ~MappedFile()
+    {
+        close();
+    }
+};
+
+// 从[p, e)中取出下一行（不含换行符），与getline一致，已到末尾时返回false
+bool nextLine(const char *&p, const char *e, const char *&line_begin, const char *&line_end)
+{
+    if (p >= e)
+        return false;
+    const char *nl = (const char *)memchr(p, '\n', e - p);
+    line_begin = p;
+    line_end = nl ? nl : e;
+    p = nl ? nl + 1 : e;
+    return true;
+}
+
+constexpr bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+// 从[p, e)中取出下一个以空白分隔的单词，与sscanf的%s一致
+constexpr bool nextWord(const char *&p, const char *e, const char *&word_begin, const char *&word_end)
+{
+    while (p < e && isBlank(*p))
+        p++;
+    if (p >= e)
+        return false;
+    word_begin = p;
+    while (p < e && !isBlank(*p))
+        p++;
+    word_end = p;
+    return true;
+}
+
+// 与sscanf的%d一致：跳过空白，读取可选的正负号和至少一位数字，忽略其后的字符
+constexpr bool parseInt(const char *p, const char *e, int &value)
+{
+    while (p < e && isBlank(*p))
+        p++;
+    bool negative = false;
+    if (p < e && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    if (p >= e || *p < '0' || *p > '9')
+        return false;
+    long long v = 0;
+    for (; p < e && *p >= '0' && *p <= '9'; p++)
+    {
+        if (v < 1000000000000LL)
+            v = v * 10 + (*p - '0');
+    }
+    value = negative ? -v : v;
+    return true;
+}
+
 void hideCursor()
 {
     cout << "\033[?25l" << std::flush;
@@ -95,27 +291,36 @@ enum class CommandId : int
     invalid,
 };
 
-CommandId parseStr(string &s)
+// 按CommandId顺序排列的指令名
+constexpr const char *COMMAND_NAMES[] = {"inbox", "outbox", "add", "sub", "copyto", "copyfrom", "jump", "jumpifzero"};
+
+// [b, e)是否恰好为以'\0'结尾的name
+constexpr bool sameWord(const char *name, const char *b, const char *e)
+{
+    for (; b < e; b++, name++)
+    {
+        if (*name != *b)
+            return false;
+    }
+    return *name == '\0';
+}
+
+// 解析[b, e)中的指令名
+constexpr CommandId parseCommand(const char *b, const char *e)
 {
-    if (s.compare("inbox") == 0)
-        return CommandId::inbox;
-    if (s.compare("outbox") == 0)
-        return CommandId::outbox;
-    if (s.compare("add") == 0)
-        return CommandId::add;
-    if (s.compare("sub") == 0)
-        return CommandId::sub;
-    if (s.compare("copyto") == 0)
-        return CommandId::copyto;
-    if (s.compare("copyfrom") == 0)
-        return CommandId::copyfrom;
-    if (s.compare("jump") == 0)
-        return CommandId::jump;
-    if (s.compare("jumpifzero") == 0)
-        return CommandId::jumpifzero;
+    for (int i = 0; i < 8; i++)
+    {
+        if (sameWord(COMMAND_NAMES[i], b, e))
+            return (CommandId)i;
+    }
     return CommandId::invalid;
 }
 
+CommandId parseStr(string &s)
+{
+    return parseCommand(s.data(), s.data() + s.size());
+}
+
 string toStr(CommandId id)
 {
     switch (id)
@@ -141,17 +346,401 @@ string toStr(CommandId id)
     }
 }
 
+// 预先解码的指令，invalid表示该行无法解析或不被允许
+struct Instruction
+{
+    CommandId id;
+    int arg;
+};
+
+// 只检查一行代码的语法，不检查该关卡是否允许以及参数范围
+constexpr bool decodeLine(const char *b, const char *e, Instruction &command)
+{
+    const char *w1b = b, *w1e = b, *w2b = b, *w2e = b, *w3b = b, *w3e = b;
+    const char *p = b;
+    int c = 0;
+    if (nextWord(p, e, w1b, w1e))
+        c++;
+    if (c == 1 && nextWord(p, e, w2b, w2e))
+        c++;
+    if (c == 2 && nextWord(p, e, w3b, w3e))
+        c++;
+    if (c <= 0 || c > 2)
+        return false;
+    CommandId id = parseCommand(w1b, w1e);
+    if (id == CommandId::invalid)
+        return false;
+    if (id < CommandId::add && c > 1)
+        return false;
+    if (id >= CommandId::add && c < 2)
+        return false;
+    command = Instruction{id, 0};
+    if (c == 1) // no arg command
+        return true;
+    return parseInt(w2b, w2e, command.arg);
+}
+
+// 指令的参数是否在范围内：空地编号小于n_playground，跳转目标为1到n_code行
+constexpr bool argInRange(const Instruction &command, int n_playground, int n_code)
+{
+    int x = command.arg;
+    switch (command.id)
+    {
+    case CommandId::add:
+    case CommandId::sub:
+    case CommandId::copyto:
+    case CommandId::copyfrom:
+        return x >= 0 && x < n_playground;
+    case CommandId::jump:
+    case CommandId::jumpifzero:
+        return x >= 1 && x <= n_code;
+    default:
+        return true;
+    }
+}
+
+// 指令集合的位掩码，第i位对应(CommandId)i
+constexpr unsigned commandBit(CommandId id)
+{
+    return 1u << (int)id;
+}
+
+const unsigned ALL_COMMANDS = (1u << (int)CommandId::invalid) - 1;
+// 只有输入输出与无条件跳转，不使用空地
+const unsigned IO_COMMANDS = commandBit(CommandId::inbox) | commandBit(CommandId::outbox) | commandBit(CommandId::jump);
+
+unsigned commandMask(const vector<CommandId> &commands)
+{
+    unsigned mask = 0;
+    for (CommandId id : commands)
+        mask |= commandBit(id);
+    return mask;
+}
+
+// 位掩码中的指令，按CommandId的顺序排列
+vector<CommandId> commandList(unsigned mask)
+{
+    vector<CommandId> commands;
+    for (int i = 0; i < (int)CommandId::invalid; i++)
+        if (mask & commandBit((CommandId)i))
+            commands.push_back((CommandId)i);
+    return commands;
+}
+
+// 将一行代码解码为指令，语法错误、关卡不允许或参数越界（执行时必然出错）时返回invalid
+// @param commands 关卡允许的指令集合，见commandMask
+// @param n_code 程序总行数，用于检查跳转目标
+Instruction compileLine(const char *b, const char *e, unsigned commands, int n_playground, int n_code)
+{
+    Instruction command;
+    if (!decodeLine(b, e, command))
+        return {CommandId::invalid, 0};
+    if (!(commands & commandBit(command.id)))
+        return {CommandId::invalid, 0};
+    if (!argInRange(command, n_playground, n_code))
+        return {CommandId::invalid, 0};
+    return command;
+}
+
+Instruction compileLine(const char *b, const char *e, const vector<CommandId> &available_command, int n_playground, int n_code)
+{
+    return compileLine(b, e, commandMask(available_command), n_playground, n_code);
+}
+
+// 快速执行路径中每行的分派码：普通指令与CommandId相同，其后为超指令
+// 超指令把从该行开始的一段常见指令序列合并为一次分派，前提不满足或剩余步数不足时退回该行的普通指令
+enum class OpCode : unsigned char
+{
+    load_add_store = (int)CommandId::invalid + 1, // copyfrom a / add b / copyto c
+    load_sub_store,                               // copyfrom a / sub b / copyto c
+    load_add,                                     // copyfrom a / add b
+    load_sub,                                     // copyfrom a / sub b
+    add_store,                                    // add b / copyto c
+    sub_store,                                    // sub b / copyto c
+    store_load,                                   // copyto a / copyfrom b
+    jump_chain,                                   // jump到另一条jump，连续跳转
+};
+
+// 窥孔优化：为每行选出最长的可合并序列，得到分派码
+// @param fuse 为false时不合并，分派码即每行的指令
+// @param ops 写入n个分派码
+void fuseProgram(const Instruction *program, int n, bool fuse, unsigned char *ops)
+{
+    auto id = [&](int i)
+    {
+        return i < n ? program[i].id : CommandId::invalid;
+    };
+    for (int i = 0; i < n; i++)
+    {
+        CommandId c0 = id(i), c1 = id(i + 1), c2 = id(i + 2);
+        bool arith1 = c1 == CommandId::add || c1 == CommandId::sub;
+        OpCode op;
+        if (!fuse)
+            op = (OpCode)c0;
+        else if (c0 == CommandId::copyfrom && arith1 && c2 == CommandId::copyto)
+            op = c1 == CommandId::add ? OpCode::load_add_store : OpCode::load_sub_store;
+        else if (c0 == CommandId::copyfrom && arith1)
+            op = c1 == CommandId::add ? OpCode::load_add : OpCode::load_sub;
+        else if ((c0 == CommandId::add || c0 == CommandId::sub) && c1 == CommandId::copyto)
+            op = c0 == CommandId::add ? OpCode::add_store : OpCode::sub_store;
+        else if (c0 == CommandId::copyto && c1 == CommandId::copyfrom)
+            op = OpCode::store_load;
+        else if (c0 == CommandId::jump && id(program[i].arg - 1) == CommandId::jump)
+            op = OpCode::jump_chain;
+        else
+            op = (OpCode)c0;
+        ops[i] = (unsigned char)op;
+    }
+}
+
+vector<unsigned char> fuseProgram(const vector<Instruction> &program, bool fuse)
+{
+    vector<unsigned char> ops(program.size());
+    fuseProgram(program.data(), program.size(), fuse, ops.data());
+    return ops;
+}
+
 class GameInfo
 {
 public:
     string title;
     vector<int> in;
-    list<int> expected_out;
+    vector<int> expected_out;
     vector<CommandId> available_command;
     int n_playground;
+    // 最大执行步数，超出视为超时
+    long long max_steps;
+    // 参考答案的步数与行数，内置关卡在编译期求出，-1表示没有参考答案
+    long long reference_steps;
+    int reference_size;
     bool _done;
 
-    GameInfo() : title(""), in({}), expected_out({}), available_command({}), n_playground(0), _done(false) {}
+    GameInfo() : title(""), in({}), expected_out({}), available_command({}), n_playground(0), max_steps(MAX_STEPS), reference_steps(-1), reference_size(-1), _done(false) {}
+};
+
+// 静态分析得到的一条结果
+struct Diagnostic
+{
+    enum Level
+    {
+        error,   // 执行到该行时必然出错
+        warning, // 执行到该行时可能出错，或该行无效但不会被执行
+        note,    // 该行不会被执行
+    };
+    int line; // 从1开始
+    Level level;
+    string message;
+
+    string toString() const
+    {
+        static const char *names[] = {"error", "warning", "note"};
+        return "line " + to_string(line) + ": " + names[level] + ": " + message;
+    }
+};
+
+// 执行前对整个程序的静态分析
+// 检查每行的参数，建立控制流图，并对手中盒子与每格空地“是否为空”做抽象解释，找出执行到时必然或可能出错的行
+// 只用于提前报告问题，不改变运行结果：一行即使必然出错，也可能因为输入耗尽而永远执行不到
+class Analyzer
+{
+    // 抽象状态中每个盒子的取值，可能为空与可能非空的组合
+    enum : unsigned char
+    {
+        MAY_EMPTY = 1,
+        MAY_FULL = 2,
+    };
+
+    const vector<string> &codes;
+    const vector<CommandId> &available_command;
+    int n_playground;
+    vector<Instruction> program;
+    // 每行执行前的抽象状态，下标0为手中盒子，其后为各格空地
+    vector<vector<unsigned char>> states;
+    vector<bool> reached;
+    vector<int> worklist;
+
+    // 与compileLine的检查顺序一致，给出一行无效的原因
+    string invalidReason(int i)
+    {
+        const char *b = codes[i].data();
+        const char *e = b + codes[i].size();
+        Instruction command;
+        if (!decodeLine(b, e, command))
+            return "syntax error";
+        if (find(available_command.begin(), available_command.end(), command.id) == available_command.end())
+            return toStr(command.id) + " is not available in this level";
+        if (command.id == CommandId::jump || command.id == CommandId::jumpifzero)
+            return "jump target " + to_string(command.arg) + " is out of range 1.." + to_string(codes.size());
+        if (n_playground == 0)
+            return "there is no playground in this level";
+        return "slot " + to_string(command.arg) + " is out of range 0.." + to_string(n_playground - 1);
+    }
+
+    // 将state合并到line行执行前的状态，有变化时重新分析该行
+    void flowTo(int line, const vector<unsigned char> &state)
+    {
+        if (line >= program.size())
+            return;
+        if (!reached[line])
+        {
+            reached[line] = true;
+            states[line] = state;
+            worklist.push_back(line);
+            return;
+        }
+        bool changed = false;
+        for (int i = 0; i < state.size(); i++)
+        {
+            unsigned char merged = states[line][i] | state[i];
+            changed = changed || merged != states[line][i];
+            states[line][i] = merged;
+        }
+        if (changed)
+            worklist.push_back(line);
+    }
+
+    // 该行需要非空的盒子：全部可能为空时必然出错，部分可能为空时可能出错
+    // @return 问题的描述，不会出错时为空
+    static string requireFull(unsigned char box, const string &what, Diagnostic::Level &level)
+    {
+        if (!(box & MAY_EMPTY))
+            return "";
+        level = box & MAY_FULL ? Diagnostic::warning : Diagnostic::error;
+        return what;
+    }
+
+    // 按一行的语义改变抽象状态并传给后继；执行到该行时必然出错则没有后继
+    void transfer(int i)
+    {
+        vector<unsigned char> state = states[i];
+        const Instruction &command = program[i];
+        int x = command.arg;
+        switch (command.id)
+        {
+        case CommandId::inbox:
+            state[0] = MAY_FULL;
+            break;
+        case CommandId::outbox:
+            if (!(state[0] & MAY_FULL))
+                return;
+            state[0] = MAY_EMPTY;
+            break;
+        case CommandId::add:
+        case CommandId::sub:
+            if (!(state[0] & MAY_FULL) || !(state[1 + x] & MAY_FULL))
+                return;
+            state[0] = MAY_FULL;
+            break;
+        case CommandId::copyto:
+        {
+            if (!(state[0] & MAY_FULL))
+                return;
+            // 与handleCopyto一致：覆盖已有盒子时手中盒子被清空
+            unsigned char hand = 0;
+            if (state[1 + x] & MAY_EMPTY)
+                hand |= MAY_FULL;
+            if (state[1 + x] & MAY_FULL)
+                hand |= MAY_EMPTY;
+            state[0] = hand;
+            state[1 + x] = MAY_FULL;
+            break;
+        }
+        case CommandId::copyfrom:
+            if (!(state[1 + x] & MAY_FULL))
+                return;
+            state[0] = MAY_FULL;
+            break;
+        case CommandId::jump:
+            flowTo(x - 1, state);
+            return;
+        case CommandId::jumpifzero:
+            if (!(state[0] & MAY_FULL))
+                return;
+            state[0] = MAY_FULL;
+            flowTo(x - 1, state);
+            break;
+        default:
+            return;
+        }
+        flowTo(i + 1, state);
+    }
+
+    // 根据到达该行时的状态判断该行是否会出错
+    void check(int i, vector<Diagnostic> &result)
+    {
+        const vector<unsigned char> &state = states[i];
+        const Instruction &command = program[i];
+        int x = command.arg;
+        Diagnostic::Level level = Diagnostic::warning;
+        string problem;
+        switch (command.id)
+        {
+        case CommandId::outbox:
+        case CommandId::copyto:
+        case CommandId::jumpifzero:
+            problem = requireFull(state[0], toStr(command.id) + " with an empty hand", level);
+            break;
+        case CommandId::add:
+        case CommandId::sub:
+            problem = requireFull(state[0], toStr(command.id) + " with an empty hand", level);
+            if (problem.empty() || level != Diagnostic::error)
+            {
+                Diagnostic::Level slot_level = Diagnostic::warning;
+                string slot_problem = requireFull(state[1 + x], toStr(command.id) + " from empty slot " + to_string(x), slot_level);
+                if (!slot_problem.empty() && (problem.empty() || slot_level == Diagnostic::error))
+                {
+                    problem = slot_problem;
+                    level = slot_level;
+                }
+            }
+            break;
+        case CommandId::copyfrom:
+            problem = requireFull(state[1 + x], "copyfrom empty slot " + to_string(x), level);
+            break;
+        default:
+            break;
+        }
+        if (problem.empty())
+            return;
+        result.push_back({i + 1, level, problem + (level == Diagnostic::error ? " always fails" : " may fail")});
+    }
+
+public:
+    Analyzer(const vector<string> &codes, const vector<CommandId> &available_command, int n_playground)
+        : codes(codes), available_command(available_command), n_playground(n_playground) {}
+
+    // @return 按行号排列的分析结果
+    vector<Diagnostic> analyze()
+    {
+        int n = codes.size();
+        program.resize(n);
+        for (int i = 0; i < n; i++)
+            program[i] = compileLine(codes[i].data(), codes[i].data() + codes[i].size(), available_command, n_playground, n);
+        states.assign(n, {});
+        reached.assign(n, false);
+        worklist.clear();
+
+        // 开始时手中与空地均为空
+        flowTo(0, vector<unsigned char>(1 + n_playground, MAY_EMPTY));
+        while (!worklist.empty())
+        {
+            int i = worklist.back();
+            worklist.pop_back();
+            transfer(i);
+        }
+
+        vector<Diagnostic> result;
+        for (int i = 0; i < n; i++)
+        {
+            if (program[i].id == CommandId::invalid)
+                result.push_back({i + 1, reached[i] ? Diagnostic::error : Diagnostic::warning, invalidReason(i) + (reached[i] ? "" : ", never executed")});
+            else if (!reached[i])
+                result.push_back({i + 1, Diagnostic::note, "never executed"});
+            else
+                check(i, result);
+        }
+        return result;
+    }
 };
 
 class Box
@@ -159,73 +748,907 @@ class Box
 public:
     int data;
     bool isEmpty;
-    Box(int data) : data(data), isEmpty(false) {}
-    Box() : data(0), isEmpty(true) {}
-    Box(const Box &other) : data(other.data), isEmpty(other.isEmpty) {}
+    constexpr Box(int data) : data(data), isEmpty(false) {}
+    constexpr Box() : data(0), isEmpty(true) {}
+    constexpr Box(const Box &other) : data(other.data), isEmpty(other.isEmpty) {}
+    constexpr Box &operator=(const Box &other)
+    {
+        data = other.data;
+        isEmpty = other.isEmpty;
+        return *this;
+    }
 
-    void empty()
+    constexpr void empty()
     {
         data = 0;
         isEmpty = true;
     }
 
-    bool isZero()
+    constexpr bool isZero() const
     {
         return !isEmpty && data == 0;
     }
 
-    void copyBox(Box &src)
+    constexpr void copyBox(const Box &src)
     {
         data = src.data;
         isEmpty = src.isEmpty;
     }
 
-    void addBox(Box &src)
+    constexpr void addBox(const Box &src)
     {
         data += src.data;
         isEmpty = src.isEmpty;
     }
 
-    void subBox(Box &src)
+    constexpr void subBox(const Box &src)
     {
         data -= src.data;
         isEmpty = src.isEmpty;
     }
 };
 
+// 涉及空地的指令对手中盒子与空地的作用，Game与编译期执行共用
+// @return 是否可以执行，不可执行（出错）时不改变任何盒子
+constexpr bool applyCopyto(Box &hand, Box &slot)
+{
+    if (hand.isEmpty)
+        return false;
+    // 覆盖已有盒子时手中盒子被清空
+    bool isOccupied = !slot.isEmpty;
+    slot = hand.data;
+    if (isOccupied)
+        hand.empty();
+    return true;
+}
+
+constexpr bool applyCopyfrom(Box &hand, const Box &slot)
+{
+    if (slot.isEmpty)
+        return false;
+    hand = slot;
+    return true;
+}
+
+constexpr bool applyAdd(Box &hand, const Box &slot)
+{
+    if (slot.isEmpty || hand.isEmpty)
+        return false;
+    hand.data += slot.data;
+    return true;
+}
+
+constexpr bool applySub(Box &hand, const Box &slot)
+{
+    if (slot.isEmpty || hand.isEmpty)
+        return false;
+    hand.data -= slot.data;
+    return true;
+}
+
+// 输出与期望输出是否完全一致
+constexpr bool outputMatched(const int *out, int n_out, const int *expected, int n_expected)
+{
+    if (n_out != n_expected)
+        return false;
+    for (int i = 0; i < n_out; i++)
+    {
+        if (out[i] != expected[i])
+            return false;
+    }
+    return true;
+}
+
+// 连续存储的一段盒子数据的只读视图，reversed为真时从末尾向前读取
+struct BoxView
+{
+    const int *data;
+    int size;
+    bool reversed;
+
+    int at(int i) const
+    {
+        return reversed ? data[size - 1 - i] : data[i];
+    }
+};
+
 enum class Result
 {
     idle,
     success,
     failed,
-    error
+    error,
+    timeout
 };
 
-// 辅助绘画关卡界面的类
-class GameScreen
+// 编译期执行使用定长数组，以下为各部分的容量
+const int CONST_MAX_BOXES = 32;
+const int CONST_MAX_COMMANDS = 8;
+const int CONST_MAX_SLOTS = 8;
+const int CONST_MAX_CODE = 64;
+
+// 可在常量表达式中使用的关卡数据
+struct ConstLevel
 {
-    const int SCREEN_LEN = 100;
-    const int SCREEN_HEIGHT = 20;
-    const int BOX_HEIGHT = 3;
-    const int BOX_WIDTH = 5;
-    const int SPLIT_SCREEN_COLUMN = 63;
-    vector<string> screen;
+    const char *title;
+    int n_in;
+    int in[CONST_MAX_BOXES];
+    int n_out;
+    int expected_out[CONST_MAX_BOXES];
+    int n_command;
+    CommandId available_command[CONST_MAX_COMMANDS];
+    int n_playground;
+};
 
-    // 若invalid为真，则盒子内字符为'X'
-    void drawBox(int r, int c, int data, bool invalid = false)
+// 可在常量表达式中使用的程序，与compileCode的结果一致
+struct ConstProgram
+{
+    int n_code;
+    Instruction code[CONST_MAX_CODE];
+};
+
+// 编译期执行的结果，与Game运行后的prevResult、step_used、current_line一致
+struct ConstResult
+{
+    Result result;
+    long long steps;
+    int line;
+    // 执行过的最大行号，其后各行对结果没有影响
+    int reached;
+};
+
+// 以importCode的格式（首行为行数）解析text，并按关卡检查每一行
+// 行数超出CONST_MAX_CODE时无法在常量表达式中求值
+constexpr ConstProgram constCompile(const ConstLevel &level, const char *text)
+{
+    ConstProgram program{};
+    const char *p = text;
+    const char *e = text;
+    while (*e)
+        e++;
+    const char *lb = p;
+    while (p < e && *p != '\n')
+        p++;
+    int n_code = 0;
+    if (!parseInt(lb, p, n_code) || n_code < 0)
+        n_code = 0;
+    program.n_code = n_code;
+    for (int i = 0; i < n_code; i++)
     {
-        int fr = r;
-        int fc = c;
-        int lr = r + BOX_HEIGHT - 1;
-        int lc = c + BOX_WIDTH - 1;
-        int mr = (fr + lr) / 2;
-        int mc = (fc + lc) / 2;
-        screen[fr][fc] = screen[fr][lc] = '+';
-        screen[lr][fc] = screen[lr][lc] = '+';
-        for (int c = fc + 1; c < lc; c++)
-            screen[fr][c] = screen[lr][c] = '-';
-        for (int r = fr + 1; r < lr; r++)
-            screen[r][fc] = screen[r][lc] = '|';
+        // 行数不足时与getline一致，补为空行
+        if (p < e)
+            p++;
+        lb = p;
+        while (p < e && *p != '\n')
+            p++;
+        Instruction command{CommandId::invalid, 0};
+        bool available = false;
+        if (decodeLine(lb, p, command))
+        {
+            for (int k = 0; k < level.n_command; k++)
+                available = available || level.available_command[k] == command.id;
+        }
+        if (available && argInRange(command, level.n_playground, n_code))
+            program.code[i] = command;
+        else
+            program.code[i] = Instruction{CommandId::invalid, 0};
+    }
+    return program;
+}
+
+// LoopDetector的定长版本
+struct ConstLoopDetector
+{
+    Box slots[CONST_MAX_SLOTS];
+    int pc;
+    Box hand;
+    long long power;
+    long long lam;
+
+    constexpr ConstLoopDetector() : slots(), pc(-1), hand(), power(1), lam(0) {}
+
+    constexpr void reset()
+    {
+        pc = -1;
+        power = 1;
+        lam = 0;
+    }
+
+    constexpr bool seen(int line, const Box &current, const Box *playground, int n_playground)
+    {
+        if (line == pc && current.isEmpty == hand.isEmpty && (current.isEmpty || current.data == hand.data))
+        {
+            bool same = true;
+            for (int i = 0; i < n_playground && same; i++)
+                same = slots[i].isEmpty == playground[i].isEmpty && slots[i].data == playground[i].data;
+            if (same)
+                return true;
+        }
+        if (++lam == power)
+        {
+            pc = line;
+            hand = current;
+            for (int i = 0; i < n_playground; i++)
+                slots[i] = playground[i];
+            power *= 2;
+            lam = 0;
+        }
+        return false;
+    }
+};
+
+// 在常量表达式中运行程序，语义与handle*系列函数及runFast一致（包括提前判定失败与死循环检测）
+constexpr ConstResult constRun(const ConstLevel &level, const ConstProgram &program, long long max_steps = MAX_STEPS)
+{
+    Box hand;
+    Box slots[CONST_MAX_SLOTS];
+    ConstLoopDetector loop_detector;
+    int in_pos = 0;
+    int n_out = 0;
+    long long steps = 0;
+    int line = 1;
+    int reached = 0;
+    // 与解释器一致，空程序在第1行出错
+    if (program.n_code == 0)
+        return ConstResult{Result::error, 0, 1, 0};
+    while (line <= program.n_code)
+    {
+        if (line > reached)
+            reached = line;
+        if (steps == max_steps)
+            return ConstResult{Result::timeout, steps, line, reached};
+        steps++;
+        const Instruction &command = program.code[line - 1];
+        int x = command.arg;
+        bool ok = true;
+        bool jumped = false;
+        switch (command.id)
+        {
+        case CommandId::inbox:
+            if (in_pos >= level.n_in)
+                return ConstResult{n_out == level.n_out ? Result::success : Result::failed, steps, -1, reached};
+            hand = level.in[in_pos++];
+            loop_detector.reset();
+            break;
+        case CommandId::outbox:
+            if (hand.isEmpty)
+                return ConstResult{Result::error, steps, line, reached};
+            // 与checkOutput一致：第一个不符合的输出即判定失败
+            if (n_out >= level.n_out || level.expected_out[n_out] != hand.data)
+                return ConstResult{Result::failed, steps, -1, reached};
+            n_out++;
+            hand.empty();
+            loop_detector.reset();
+            break;
+        case CommandId::copyto:
+            ok = applyCopyto(hand, slots[x]);
+            break;
+        case CommandId::copyfrom:
+            ok = applyCopyfrom(hand, slots[x]);
+            break;
+        case CommandId::add:
+            ok = applyAdd(hand, slots[x]);
+            break;
+        case CommandId::sub:
+            ok = applySub(hand, slots[x]);
+            break;
+        case CommandId::jump:
+            jumped = true;
+            break;
+        case CommandId::jumpifzero:
+            ok = !hand.isEmpty;
+            jumped = hand.isZero();
+            break;
+        default:
+            ok = false;
+            break;
+        }
+        if (!ok)
+            return ConstResult{Result::error, steps, line, reached};
+        if (jumped)
+        {
+            line = x;
+            if (loop_detector.seen(line, hand, slots, level.n_playground))
+                return ConstResult{Result::timeout, steps, line, reached};
+        }
+        else
+            line++;
+    }
+    return ConstResult{n_out == level.n_out ? Result::success : Result::failed, steps, -1, reached};
+}
+
+// 将关卡转换为编译期执行使用的定长数据，以便在运行时调用constRun
+// @return 关卡是否在容量之内
+bool toConstLevel(const GameInfo &info, ConstLevel &level)
+{
+    if (info.in.size() > CONST_MAX_BOXES || info.expected_out.size() > CONST_MAX_BOXES ||
+        info.available_command.size() > CONST_MAX_COMMANDS || info.n_playground > CONST_MAX_SLOTS)
+        return false;
+    level = ConstLevel{};
+    level.title = "";
+    level.n_in = info.in.size();
+    copy(info.in.begin(), info.in.end(), level.in);
+    level.n_out = info.expected_out.size();
+    copy(info.expected_out.begin(), info.expected_out.end(), level.expected_out);
+    level.n_command = info.available_command.size();
+    copy(info.available_command.begin(), info.available_command.end(), level.available_command);
+    level.n_playground = info.n_playground;
+    return true;
+}
+
+// @return 程序是否在容量之内
+bool toConstProgram(const vector<Instruction> &program, ConstProgram &result)
+{
+    if (program.size() > CONST_MAX_CODE)
+        return false;
+    result = ConstProgram{};
+    result.n_code = program.size();
+    copy(program.begin(), program.end(), result.code);
+    return true;
+}
+
+// 关卡包的二进制格式：LevelPackHeader之后依次为n_level个LevelRecord、n_values个int（各关卡的输入与期望输出首尾相接）、
+// titles_size字节的标题（各以'\0'结尾），数值按本机字节序存放
+struct LevelPackHeader
+{
+    char magic[4]; // "HRML"
+    int version;
+    int n_level;
+    int reserved;
+    long long n_values;
+    long long titles_size;
+};
+
+struct LevelRecord
+{
+    // values中的下标与个数
+    long long in_begin;
+    long long n_in;
+    long long out_begin;
+    long long n_out;
+    long long max_steps;
+    // 参考答案的步数与行数，-1表示没有
+    long long reference_steps;
+    int reference_size;
+    // titles中的偏移
+    int title;
+    unsigned commands;
+    int n_playground;
+};
+
+const int LEVEL_PACK_VERSION = 1;
+// 关卡包中空地数的上限，防止损坏的文件申请过多内存
+const int LEVEL_PACK_MAX_PLAYGROUND = 256;
+
+// 按关卡包的二进制格式排列levels
+vector<char> levelPackImage(const vector<GameInfo> &levels)
+{
+    vector<int> values;
+    string titles;
+    vector<LevelRecord> records;
+    for (const GameInfo &info : levels)
+    {
+        LevelRecord record = {};
+        record.in_begin = values.size();
+        record.n_in = info.in.size();
+        values.insert(values.end(), info.in.begin(), info.in.end());
+        record.out_begin = values.size();
+        record.n_out = info.expected_out.size();
+        values.insert(values.end(), info.expected_out.begin(), info.expected_out.end());
+        record.max_steps = info.max_steps;
+        record.reference_steps = info.reference_steps;
+        record.reference_size = info.reference_size;
+        record.title = titles.size();
+        titles += info.title;
+        titles += '\0';
+        record.commands = commandMask(info.available_command);
+        record.n_playground = info.n_playground;
+        records.push_back(record);
+    }
+    LevelPackHeader header = {{'H', 'R', 'M', 'L'}, LEVEL_PACK_VERSION, (int)levels.size(), 0, (long long)values.size(), (long long)titles.size()};
+    vector<char> image(sizeof(header) + records.size() * sizeof(LevelRecord) + values.size() * sizeof(int) + titles.size());
+    char *p = image.data();
+    memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
+    memcpy(p, records.data(), records.size() * sizeof(LevelRecord));
+    p += records.size() * sizeof(LevelRecord);
+    memcpy(p, values.data(), values.size() * sizeof(int));
+    p += values.size() * sizeof(int);
+    memcpy(p, titles.data(), titles.size());
+    return image;
+}
+
+// 只读的关卡目录，内容为关卡包的二进制格式，构造或打开后不再修改，可在多个线程中共享
+// 从文件打开时只映射文件并检查各关卡的记录，输入与期望输出在用到时才由系统读入，打开的耗时只与关卡数有关
+class LevelCatalog
+{
+public:
+    // 一个关卡的视图，指针指向目录中的数据，不复制
+    struct Level
+    {
+        const char *title;
+        const int *in;
+        int n_in;
+        const int *expected_out;
+        int n_out;
+        unsigned commands;
+        int n_playground;
+        long long max_steps;
+        // 参考答案的步数与行数，-1表示没有参考答案
+        long long reference_steps;
+        int reference_size;
+    };
+
+private:
+    MappedFile file;
+    vector<char> image;
+    const LevelRecord *records = nullptr;
+    const int *values = nullptr;
+    const char *titles = nullptr;
+    int n_level = 0;
+
+    // 检查头部与每个关卡的记录，保证level取出的指针都在数据之内、步数上限为正
+    bool attach(const char *data, size_t size, string &error)
+    {
+        LevelPackHeader header;
+        if (size < sizeof(header))
+        {
+            error = "file too short";
+            return false;
+        }
+        memcpy(&header, data, sizeof(header));
+        if (memcmp(header.magic, "HRML", 4) != 0 || header.version != LEVEL_PACK_VERSION)
+        {
+            error = "not a level pack of version " + to_string(LEVEL_PACK_VERSION);
+            return false;
+        }
+        // 每一项先与剩余的字节数比较再相乘，损坏的头部不会使计算溢出
+        size_t rest = size - sizeof(header);
+        bool sized = header.n_level >= 0 && (unsigned long long)header.n_level <= rest / sizeof(LevelRecord);
+        if (sized)
+        {
+            rest -= header.n_level * sizeof(LevelRecord);
+            sized = header.n_values >= 0 && (unsigned long long)header.n_values <= rest / sizeof(int);
+        }
+        if (sized)
+        {
+            rest -= header.n_values * sizeof(int);
+            sized = header.titles_size >= 0 && (unsigned long long)header.titles_size == rest;
+        }
+        if (!sized)
+        {
+            error = "size does not match the header";
+            return false;
+        }
+        records = (const LevelRecord *)(data + sizeof(header));
+        values = (const int *)(records + header.n_level);
+        titles = (const char *)(values + header.n_values);
+        if (header.titles_size > 0 && titles[header.titles_size - 1] != '\0')
+        {
+            error = "titles are not terminated";
+            return false;
+        }
+        for (int i = 0; i < header.n_level; i++)
+        {
+            const LevelRecord &r = records[i];
+            if (r.n_in < 0 || r.n_in > INT32_MAX || r.in_begin < 0 || r.in_begin > header.n_values - r.n_in ||
+                r.n_out < 0 || r.n_out > INT32_MAX || r.out_begin < 0 || r.out_begin > header.n_values - r.n_out ||
+                r.title < 0 || r.title >= header.titles_size || r.n_playground < 0 || r.n_playground > LEVEL_PACK_MAX_PLAYGROUND)
+            {
+                error = "level " + to_string(i + 1) + ": record out of range";
+                return false;
+            }
+            // 步数上限不为正时运行不受限制，不能留到validateLevels才检查
+            if (r.max_steps <= 0)
+            {
+                error = "level " + to_string(i + 1) + ": max_steps must be positive";
+                return false;
+            }
+        }
+        n_level = header.n_level;
+        return true;
+    }
+
+public:
+    LevelCatalog() {}
+    LevelCatalog(const LevelCatalog &) = delete;
+    LevelCatalog &operator=(const LevelCatalog &) = delete;
+
+    explicit LevelCatalog(const vector<GameInfo> &levels) : image(levelPackImage(levels))
+    {
+        string error;
+        attach(image.data(), image.size(), error);
+    }
+
+    // 打开关卡包，二进制格式的文件直接映射，其余按文本格式解析，见parseLevelText
+    bool open(const string &path, string &error);
+
+    int size() const
+    {
+        return n_level;
+    }
+
+    // @param i 关卡下标，从0开始
+    Level level(int i) const
+    {
+        const LevelRecord &r = records[i];
+        return {titles + r.title,
+                values + r.in_begin, (int)r.n_in,
+                values + r.out_begin, (int)r.n_out,
+                r.commands, r.n_playground, r.max_steps, r.reference_steps, r.reference_size};
+    }
+
+    // 二进制格式的全部内容
+    const char *data() const
+    {
+        return image.empty() ? file.data : image.data();
+    }
+
+    size_t dataSize() const
+    {
+        return image.empty() ? file.size : image.size();
+    }
+};
+
+// 以GameInfo的数据构成的关卡视图，在info的生存期内有效，用于不在目录中的关卡
+LevelCatalog::Level levelView(const GameInfo &info)
+{
+    return {info.title.c_str(),
+            info.in.data(), (int)info.in.size(),
+            info.expected_out.data(), (int)info.expected_out.size(),
+            commandMask(info.available_command), info.n_playground, info.max_steps, info.reference_steps, info.reference_size};
+}
+
+// 关卡包中输入与期望输出的绝对值上限，文本格式的数值最多9位
+const int LEVEL_PACK_MAX_VALUE = 999999999;
+
+// 解析[b, e)中的一个完整的整数，不允许其后有多余的字符
+// @param max_digits 最多的位数，超出视为越界
+bool parseWholeNumber(const char *b, const char *e, long long &value, int max_digits)
+{
+    bool negative = b < e && *b == '-';
+    if (b < e && (*b == '-' || *b == '+'))
+        b++;
+    if (b == e || e - b > max_digits)
+        return false;
+    value = 0;
+    for (; b < e; b++)
+    {
+        if (*b < '0' || *b > '9')
+            return false;
+        value = value * 10 + (*b - '0');
+    }
+    if (negative)
+        value = -value;
+    return true;
+}
+
+// 解析关卡包的文本格式，每行一项，空行与#开头的行忽略：
+//   title <标题>         开始一个新关卡，标题为该行其余部分
+//   in <整数>...         输入，可分为多行
+//   out <整数>...        期望输出，可分为多行
+//   commands <指令>...   允许的指令
+//   playground <空地数>
+//   max_steps <步数>     可省略，默认为MAX_STEPS
+//   par <步数> <行数>    参考答案的步数与行数，可省略
+// @return 是否解析成功，失败时error为出错的行与原因
+bool parseLevelText(const char *p, const char *e, vector<GameInfo> &levels, string &error)
+{
+    levels.clear();
+    const char *lb, *le, *wb, *we;
+    int line_no = 0;
+    while (nextLine(p, e, lb, le))
+    {
+        line_no++;
+        const char *q = lb;
+        if (!nextWord(q, le, wb, we) || *wb == '#')
+            continue;
+        string key(wb, we);
+        string where = "line " + to_string(line_no) + ": ";
+        if (key == "title")
+        {
+            while (q < le && isBlank(*q))
+                q++;
+            const char *te = le;
+            while (te > q && isBlank(te[-1]))
+                te--;
+            levels.push_back(GameInfo());
+            levels.back().title.assign(q, te);
+            continue;
+        }
+        if (levels.empty())
+        {
+            error = where + key + " before the first title";
+            return false;
+        }
+        GameInfo &info = levels.back();
+        if (key == "commands")
+        {
+            while (nextWord(q, le, wb, we))
+            {
+                CommandId id = parseCommand(wb, we);
+                if (id == CommandId::invalid)
+                {
+                    error = where + "unknown command " + string(wb, we);
+                    return false;
+                }
+                info.available_command.push_back(id);
+            }
+            continue;
+        }
+        vector<long long> numbers;
+        long long value;
+        while (nextWord(q, le, wb, we))
+        {
+            if (!parseWholeNumber(wb, we, value, key == "max_steps" || key == "par" ? 18 : 9))
+            {
+                error = where + "bad number " + string(wb, we);
+                return false;
+            }
+            numbers.push_back(value);
+        }
+        if (key == "in")
+            info.in.insert(info.in.end(), numbers.begin(), numbers.end());
+        else if (key == "out")
+            info.expected_out.insert(info.expected_out.end(), numbers.begin(), numbers.end());
+        else if (key == "playground" && numbers.size() == 1)
+            info.n_playground = numbers[0];
+        else if (key == "max_steps" && numbers.size() == 1)
+            info.max_steps = numbers[0];
+        else if (key == "par" && numbers.size() == 2 && numbers[1] <= INT32_MAX && numbers[1] >= INT32_MIN)
+        {
+            info.reference_steps = numbers[0];
+            info.reference_size = numbers[1];
+        }
+        else
+        {
+            error = where + "cannot read " + key;
+            return false;
+        }
+    }
+    return true;
+}
+
+// 在text后追加一个数组，每行最多32个数，数组为空时也写出一行
+void appendLevelValues(string &text, const char *key, const int *values, int n)
+{
+    for (int i = 0; i == 0 || i < n; i += 32)
+    {
+        text += key;
+        for (int k = i; k < n && k < i + 32; k++)
+            text += " " + to_string(values[k]);
+        text += "\n";
+    }
+}
+
+// 以文本格式写出目录中的关卡，可由parseLevelText读回
+string levelText(const LevelCatalog &catalog)
+{
+    string text = "# level pack, " + to_string(catalog.size()) + " levels\n";
+    for (int i = 0; i < catalog.size(); i++)
+    {
+        LevelCatalog::Level level = catalog.level(i);
+        text += "\ntitle " + string(level.title) + "\n";
+        appendLevelValues(text, "in", level.in, level.n_in);
+        appendLevelValues(text, "out", level.expected_out, level.n_out);
+        text += "commands";
+        for (CommandId id : commandList(level.commands))
+            text += " " + toStr(id);
+        text += "\nplayground " + to_string(level.n_playground) + "\n";
+        text += "max_steps " + to_string(level.max_steps) + "\n";
+        if (level.reference_steps >= 0 || level.reference_size >= 0)
+            text += "par " + to_string(level.reference_steps) + " " + to_string(level.reference_size) + "\n";
+    }
+    return text;
+}
+
+bool LevelCatalog::open(const string &path, string &error)
+{
+    image.clear();
+    n_level = 0;
+    if (!file.open(path))
+    {
+        error = "cannot open " + path;
+        return false;
+    }
+    if (file.size >= 4 && memcmp(file.data, "HRML", 4) == 0)
+        return attach(file.data, file.size, error);
+    vector<GameInfo> levels;
+    bool parsed = parseLevelText(file.data, file.data + file.size, levels, error);
+    file.close();
+    if (!parsed)
+        return false;
+    image = levelPackImage(levels);
+    return attach(image.data(), image.size(), error);
+}
+
+// 检查目录中各关卡的内容，打开时只检查了数据的范围与步数上限，这里逐个检查数值
+// @return 发现的问题，每项以关卡的序号开头，没有问题时为空
+vector<string> validateLevels(const LevelCatalog &catalog)
+{
+    vector<string> problems;
+    if (catalog.size() == 0)
+        problems.push_back("no levels");
+    const unsigned SLOT_COMMANDS = commandBit(CommandId::add) | commandBit(CommandId::sub) | commandBit(CommandId::copyto) | commandBit(CommandId::copyfrom);
+    for (int i = 0; i < catalog.size(); i++)
+    {
+        LevelCatalog::Level level = catalog.level(i);
+        string where = "level " + to_string(i + 1) + ": ";
+        if (level.title[0] == '\0')
+            problems.push_back(where + "empty title");
+        if (strpbrk(level.title, "\r\n") != nullptr)
+            problems.push_back(where + "line break in the title");
+        if ((level.commands & ~ALL_COMMANDS) != 0)
+            problems.push_back(where + "unknown commands");
+        if (level.n_out > 0 && (level.commands & commandBit(CommandId::outbox)) == 0)
+            problems.push_back(where + "expected output without outbox");
+        if (level.n_playground == 0 && (level.commands & SLOT_COMMANDS) != 0)
+            problems.push_back(where + "commands on the playground without playground");
+        for (int k = 0; k < level.n_in + level.n_out; k++)
+        {
+            int v = k < level.n_in ? level.in[k] : level.expected_out[k - level.n_in];
+            if (v < -LEVEL_PACK_MAX_VALUE || v > LEVEL_PACK_MAX_VALUE)
+            {
+                problems.push_back(where + "value " + to_string(v) + " out of range");
+                break;
+            }
+        }
+        if (level.reference_steps == 0 || level.reference_steps < -1 || level.reference_steps > level.max_steps)
+            problems.push_back(where + "par steps out of range");
+        if (level.reference_size == 0 || level.reference_size < -1)
+            problems.push_back(where + "par size out of range");
+    }
+    return problems;
+}
+
+// 一次运行的性能分析数据，下标均从0开始
+class Profile
+{
+    // 以k、M为单位的简短计数
+    static string shortCount(long long n)
+    {
+        if (n >= 10000000)
+            return to_string(n / 1000000) + "M";
+        if (n >= 10000)
+            return to_string(n / 1000) + "k";
+        return to_string(n);
+    }
+
+public:
+    // 每行被执行的次数
+    vector<long long> line_hits;
+    // jumpifzero每行跳转与不跳转的次数
+    vector<long long> jump_taken;
+    vector<long long> jump_not_taken;
+    // 空地每格被读取（copyfrom/add/sub）与写入（copyto）的次数
+    vector<long long> slot_reads;
+    vector<long long> slot_writes;
+
+    void reset(int n_code, int n_playground)
+    {
+        line_hits.assign(n_code, 0);
+        jump_taken.assign(n_code, 0);
+        jump_not_taken.assign(n_code, 0);
+        slot_reads.assign(n_playground, 0);
+        slot_writes.assign(n_playground, 0);
+    }
+
+    bool empty() const
+    {
+        return line_hits.empty();
+    }
+
+    // 每行的执行次数，供代码窗口显示
+    string hitText(int line) const
+    {
+        if (line < 0 || line >= line_hits.size() || line_hits[line] == 0)
+            return "";
+        return "x" + shortCount(line_hits[line]);
+    }
+
+    // 按指令统计的执行次数，由每行执行次数得到
+    vector<long long> commandHits(const vector<Instruction> &program) const
+    {
+        vector<long long> hits((int)CommandId::invalid + 1, 0);
+        for (int i = 0; i < line_hits.size() && i < program.size(); i++)
+            hits[(int)program[i].id] += line_hits[i];
+        return hits;
+    }
+
+    // 文字或json格式的报告
+    string report(const vector<Instruction> &program, const vector<string> &codes, bool json) const
+    {
+        vector<long long> hits = commandHits(program);
+        string text;
+        if (json)
+        {
+            text = "{\"lines\":[";
+            for (int i = 0; i < line_hits.size(); i++)
+            {
+                if (i > 0)
+                    text += ",";
+                text += "{\"line\":" + to_string(i + 1) + ",\"hits\":" + to_string(line_hits[i]);
+                if (program[i].id == CommandId::jumpifzero)
+                    text += ",\"taken\":" + to_string(jump_taken[i]) + ",\"not_taken\":" + to_string(jump_not_taken[i]);
+                text += "}";
+            }
+            text += "],\"commands\":{";
+            for (int id = 0; id < hits.size(); id++)
+            {
+                if (id > 0)
+                    text += ",";
+                string name = id == (int)CommandId::invalid ? "invalid" : toStr((CommandId)id);
+                text += "\"" + name + "\":" + to_string(hits[id]);
+            }
+            text += "},\"slots\":[";
+            for (int i = 0; i < slot_reads.size(); i++)
+            {
+                if (i > 0)
+                    text += ",";
+                text += "{\"slot\":" + to_string(i) + ",\"reads\":" + to_string(slot_reads[i]) + ",\"writes\":" + to_string(slot_writes[i]) + "}";
+            }
+            text += "]}";
+            return text;
+        }
+
+        text = "line  hits        code\n";
+        for (int i = 0; i < line_hits.size(); i++)
+        {
+            string line = to_string(i + 1);
+            string count = to_string(line_hits[i]);
+            text += line + string(max(1, 6 - (int)line.size()), ' ') + count + string(max(1, 12 - (int)count.size()), ' ');
+            text += i < codes.size() ? codes[i] : toStr(program[i].id);
+            if (program[i].id == CommandId::jumpifzero)
+                text += "  (taken " + to_string(jump_taken[i]) + ", not taken " + to_string(jump_not_taken[i]) + ")";
+            text += "\n";
+        }
+        text += "commands:";
+        for (int id = 0; id < (int)CommandId::invalid; id++)
+        {
+            if (hits[id] > 0)
+                text += " " + toStr((CommandId)id) + "=" + to_string(hits[id]);
+        }
+        if (hits[(int)CommandId::invalid] > 0)
+            text += " invalid=" + to_string(hits[(int)CommandId::invalid]);
+        text += "\nslots:";
+        for (int i = 0; i < slot_reads.size(); i++)
+            text += " " + to_string(i) + "(r" + to_string(slot_reads[i]) + "/w" + to_string(slot_writes[i]) + ")";
+        return text;
+    }
+};
+
+// 辅助绘画关卡界面的类
+class GameScreen
+{
+    const int SCREEN_LEN = 100;
+    const int SCREEN_HEIGHT = 20;
+    const int BOX_HEIGHT = 3;
+    const int BOX_WIDTH = 5;
+    const int SPLIT_SCREEN_COLUMN = 63;
+    vector<string> screen;
+    // 上一帧已输出到终端的内容
+    vector<string> front;
+
+    static char charAt(const string &line, int i)
+    {
+        return i < line.size() ? line[i] : ' ';
+    }
+
+    // 若invalid为真，则盒子内字符为'X'
+    void drawBox(int r, int c, int data, bool invalid = false)
+    {
+        int fr = r;
+        int fc = c;
+        int lr = r + BOX_HEIGHT - 1;
+        int lc = c + BOX_WIDTH - 1;
+        int mr = (fr + lr) / 2;
+        int mc = (fc + lc) / 2;
+        screen[fr][fc] = screen[fr][lc] = '+';
+        screen[lr][fc] = screen[lr][lc] = '+';
+        for (int c = fc + 1; c < lc; c++)
+            screen[fr][c] = screen[lr][c] = '-';
+        for (int r = fr + 1; r < lr; r++)
+            screen[r][fc] = screen[r][lc] = '|';
         if (invalid)
         {
             screen[mr][mc] = 'X';
@@ -247,23 +1670,13 @@ class GameScreen
             screen[mr][mc] = txt[0];
     }
 
-    void drawBoxesVertical(int c, list<Box> &boxes, int n_max)
+    void drawBoxesVertical(int c, const BoxView &boxes, int n_max)
     {
-        list<Box>::iterator it;
         int i = 0;
-        for (it = boxes.begin(); it != boxes.end(); ++it)
+        for (; i < boxes.size && i < n_max; i++)
         {
-            int data = (*it).data;
             int r = i * BOX_HEIGHT;
-
-            if ((*it).isEmpty)
-                drawBox(r, c, 0, true);
-            else
-                drawBox(r, c, data);
-
-            i++;
-            if (i >= n_max)
-                break;
+            drawBox(r, c, boxes.at(i));
         }
         for (; i < n_max; i++)
         {
@@ -323,7 +1736,9 @@ class GameScreen
         }
     }
 
-    void drawCodeBlock(vector<string> &code, int current_line = -1, int MAX_LINE = 5)
+    // @param profile 不为空时在每行代码后显示执行次数
+    // @param breakpoints 不为空时在设有断点的行前显示'*'
+    void drawCodeBlock(vector<string> &code, int current_line = -1, int MAX_LINE = 5, const Profile *profile = nullptr, const vector<bool> *breakpoints = nullptr)
     {
         for (int i = 0; i < 5; i++)
         {
@@ -371,12 +1786,21 @@ class GameScreen
 
             if ((i + 1) == current_line)
                 screen[_r][_c - 2] = '>';
+            if (breakpoints != nullptr && i < breakpoints->size() && (*breakpoints)[i])
+                screen[_r][_c - 3] = '*';
+            if (profile != nullptr)
+            {
+                string hits = profile->hitText(i);
+                for (int j = 0; j < hits.length(); j++)
+                    screen[_r][_c + 16 + j] = hits[j];
+            }
             _r++;
         }
     }
 
 public:
-    void drawResultBlock(Result status, int step_used = 0)
+    // @param detail 附加的一行说明，为空则不显示
+    void drawResultBlock(Result status, long long step_used = 0, string detail = "")
     {
         int _r = 10;
         for (int i = 0; i < 5; i++)
@@ -402,6 +1826,8 @@ public:
             text = "> Mission Accomplished!";
         else if (status == Result::failed)
             text = "> Mission Failed!";
+        else if (status == Result::timeout)
+            text = "> Time Limit Exceeded!";
         int _c = SPLIT_SCREEN_COLUMN + 4;
         _r += 1;
         for (int i = 0; i < text.length(); i++)
@@ -413,6 +1839,13 @@ public:
         _r += 1;
         for (int i = 0; i < text.length(); i++)
             screen[_r][_c + i] = text[i];
+
+        if (detail.empty())
+            return;
+        text = "> " + detail;
+        _r += 1;
+        for (int i = 0; i < text.length() && _c + i < SCREEN_LEN; i++)
+            screen[_r][_c + i] = text[i];
     }
 
     void drawAvailableCommand(vector<CommandId> &available_command)
@@ -460,7 +1893,7 @@ public:
         }
     }
 
-    void draw(list<Box> &in, list<Box> &out, vector<Box> &playground, vector<string> &code, int current_line, int robot_column, Box &box_taken)
+    void draw(const BoxView &in, const BoxView &out, vector<Box> &playground, vector<string> &code, int current_line, int robot_column, Box &box_taken, const Profile *profile = nullptr, const vector<bool> *breakpoints = nullptr)
     {
         // draw In Boxes
         drawBoxesVertical(BOX_WIDTH + 1, in, 6);
@@ -471,20 +1904,70 @@ public:
         drawRobot(BOX_HEIGHT, robot_column * (BOX_WIDTH + 1), box_taken);
 
         drawSeperateLine();
-        drawCodeBlock(code, current_line, 8);
+        drawCodeBlock(code, current_line, 8, profile, breakpoints);
     }
 
-    void print()
+    // 将标题、画面与底部信息组成一帧，与上一帧比较后只输出变化的部分
+    // 所有输出合并为一次写入，结束后光标位于帧下方，并清除其后的内容
+    void present(const vector<string> &header, const vector<string> &footer)
     {
-        for (string s : screen)
+        vector<string> frame = header;
+        for (int i = 0; i < SCREEN_HEIGHT; i++)
+            frame.push_back(screen[i].substr(0, SCREEN_LEN));
+        for (const string &line : footer)
+            frame.push_back(line.substr(0, SCREEN_LEN));
+
+        string out;
+        if (front.empty())
+            out += "\033[H\033[J";
+        for (int r = 0; r < frame.size(); r++)
         {
-            cout << s << endl;
+            const string &now = frame[r];
+            const string empty_line;
+            const string &old = r < front.size() ? front[r] : empty_line;
+            int width = max(now.size(), old.size());
+            int c = 0;
+            while (c < width)
+            {
+                // 找到一段变化的字符，间隔很短的两段合并输出以减少光标移动
+                if (charAt(now, c) == charAt(old, c))
+                {
+                    c++;
+                    continue;
+                }
+                int end = c + 1;
+                int same = 0;
+                for (int k = end; k < width && same < 8; k++)
+                {
+                    if (charAt(now, k) == charAt(old, k))
+                        same++;
+                    else
+                    {
+                        same = 0;
+                        end = k + 1;
+                    }
+                }
+                out += "\033[" + to_string(r + 1) + ";" + to_string(c + 1) + "H";
+                for (int k = c; k < end; k++)
+                    out += charAt(now, k);
+                c = end;
+            }
         }
+        out += "\033[" + to_string(frame.size() + 1) + ";1H\033[J";
+        cout.write(out.data(), out.size());
+        cout.flush();
+        front.swap(frame);
     }
 
-    void clear()
+    // 终端内容被其他输出破坏时调用，下一帧完整重绘
+    void invalidate()
     {
-        for (int i = 0; i < SCREEN_HEIGHT; i++)
+        front.clear();
+    }
+
+    void clear()
+    {
+        for (int i = 0; i < SCREEN_HEIGHT; i++)
         {
             for (int j = 0; j < SCREEN_LEN; j++)
             {
@@ -494,654 +1977,3783 @@ public:
     }
 };
 
-// 关卡类， 用来执行关卡部分的主要逻辑以及操作
-class Game
+// 执行轨迹中的一步：执行的行以及该步对运行状态的改变
+struct TraceStep
 {
-    void goToPlayGround(int x)
-    {
-        int target_column = 3 + x;
-        while (robot_column < target_column)
-        {
-            delay(step_delay);
-            robot_column += 1;
-            updateScreen();
-        }
-        while (robot_column > target_column)
-        {
-            delay(step_delay);
-            robot_column -= 1;
-            updateScreen();
-        }
-    }
+    int line;            // 执行的行，从0开始
+    int value;           // 手中盒子的新值、写入空地的值或输出的值
+    short slot;          // 操作的空地，-1表示无；只有flags含SLOT_SET时才写入
+    unsigned char op;    // CommandId
+    unsigned char flags; // Trace::HAND_SET等的组合
+};
 
-    void goToInBox()
+// 轨迹检查点：执行了若干步之后的运行状态，空地另存于Trace::checkpoint_slots
+struct TraceCheckpoint
+{
+    long long in_pos;   // 已取走的输入个数
+    long long out_size; // 已输出的个数，输出内容为Trace::outputs的前缀
+    int hand;
+    int hand_full;
+};
+
+// 检查点中空地的一格
+struct TraceSlot
+{
+    int data;
+    int full;
+};
+
+// 轨迹文件头，其后依次为输入、输出、每一步、检查点、检查点中的空地，均为本机字节序
+struct TraceHeader
+{
+    char magic[4]; // "HRMT"
+    int version;
+    int n_playground;
+    int interval;
+    long long n_steps;
+    long long n_inputs;
+    long long n_outputs;
+    long long n_checkpoints;
+    int result;
+    int final_line;
+    int fail_index;
+    int fail_value;
+    int loop_detected;
+    int reserved;
+};
+
+// 一次无动画运行的执行轨迹
+// 运行结束后每隔CHECKPOINT_INTERVAL步保存一个检查点，恢复到任意一步只需从之前的检查点重放不超过该间隔的步数
+class Trace
+{
+    static const int VERSION = 1;
+
+    template <class T>
+    static void writeArray(ofstream &file, const vector<T> &v)
     {
-        while (robot_column > 3)
-        {
-            delay(step_delay);
-            robot_column -= 1;
-            updateScreen();
-        }
+        file.write((const char *)v.data(), v.size() * sizeof(T));
     }
 
-    void goToOutBox()
+    template <class T>
+    static const char *readArray(const char *p, vector<T> &v, long long n)
     {
-        while (robot_column < 6)
-        {
-            delay(step_delay);
-            robot_column += 1;
-            updateScreen();
-        }
+        v.resize(n);
+        memcpy(v.data(), p, n * sizeof(T));
+        return p + n * sizeof(T);
     }
 
-    bool handleInbox(bool animate)
+public:
+    enum : unsigned char
     {
-        if (in_boxes.size() == 0)
-            return false;
-        if (animate)
-        {
-            goToInBox();
-        }
+        HAND_SET = 1,   // 手中盒子变为value
+        HAND_EMPTY = 2, // 手中盒子被清空
+        SLOT_SET = 4,   // 空地slot变为value
+        IN_POP = 8,     // 取走一个输入
+        OUT_PUSH = 16,  // 输出value
+    };
+    static const int CHECKPOINT_INTERVAL = 4096;
 
-        box_taken = in_boxes.front();
-        in_boxes.pop_front();
+    vector<TraceStep> steps;
+    // 运行的输入，以及全部输出（输出只在末尾追加，任意一步时的输出都是它的前缀）
+    vector<int> inputs;
+    vector<int> outputs;
+    int n_playground = 0;
+    int interval = CHECKPOINT_INTERVAL;
+    // 第k个检查点为执行k * interval步之后的状态
+    vector<TraceCheckpoint> checkpoints;
+    vector<TraceSlot> checkpoint_slots;
+    // 运行结果，与Game中同名成员一致
+    Result result = Result::idle;
+    int final_line = -1;
+    int fail_index = -1;
+    int fail_value = 0;
+    bool loop_detected = false;
 
-        if (animate)
-        {
-            delay(step_delay);
-            updateScreen();
-        }
+    void clear()
+    {
+        steps.clear();
+        outputs.clear();
+        checkpoints.clear();
+        checkpoint_slots.clear();
+    }
 
-        return true;
+    // 记录新的一步，出错的一步不改变状态
+    void push(int line, CommandId id)
+    {
+        steps.push_back({line, 0, -1, (unsigned char)id, 0});
     }
 
-    bool handleOutbox(bool animate)
+    // 记录最近一步对状态的改变
+    void set(unsigned char flags, int slot, int value)
     {
-        if (box_taken.isEmpty)
-            return false;
-        if (animate)
+        TraceStep &step = steps.back();
+        step.flags = flags;
+        step.slot = slot;
+        step.value = value;
+    }
+
+    // 运行结束后调用，按记录的每一步重放一遍，得到全部输出与检查点
+    void finish(const vector<int> &in, int n_slots)
+    {
+        inputs = in;
+        n_playground = n_slots;
+        outputs.clear();
+        checkpoints.clear();
+        checkpoint_slots.clear();
+        TraceCheckpoint state = {0, 0, 0, 0};
+        vector<TraceSlot> slots(n_slots, {0, 0});
+        for (size_t i = 0;; i++)
         {
-            goToOutBox();
+            if (i % interval == 0)
+            {
+                checkpoints.push_back(state);
+                checkpoint_slots.insert(checkpoint_slots.end(), slots.begin(), slots.end());
+            }
+            if (i == steps.size())
+                break;
+            const TraceStep &step = steps[i];
+            if (step.flags & IN_POP)
+                state.in_pos++;
+            if (step.flags & OUT_PUSH)
+            {
+                outputs.push_back(step.value);
+                state.out_size++;
+            }
+            if (step.flags & SLOT_SET)
+                slots[step.slot] = {step.value, 1};
+            if (step.flags & HAND_SET)
+                state = {state.in_pos, state.out_size, step.value, 1};
+            if (step.flags & HAND_EMPTY)
+                state = {state.in_pos, state.out_size, 0, 0};
         }
+    }
 
-        out_boxes.push_front(box_taken);
-        current_out.push_back(box_taken.data);
-        box_taken.empty();
+    // 不晚于第n步的最近一个检查点
+    long long checkpointBefore(long long n) const
+    {
+        return n / interval;
+    }
 
-        if (animate)
-        {
-            delay(step_delay);
-            updateScreen();
-        }
+    const TraceSlot *slotsOf(long long k) const
+    {
+        return checkpoint_slots.data() + k * n_playground;
+    }
 
-        return true;
+    // 将finish后的轨迹写入文件
+    bool save(const string &path) const
+    {
+        ofstream file(path, ios::binary);
+        if (!file)
+            return false;
+        TraceHeader header = {{'H', 'R', 'M', 'T'}, VERSION, n_playground, interval,
+                              (long long)steps.size(), (long long)inputs.size(), (long long)outputs.size(), (long long)checkpoints.size(),
+                              (int)result, final_line, fail_index, fail_value, loop_detected, 0};
+        file.write((const char *)&header, sizeof(header));
+        writeArray(file, inputs);
+        writeArray(file, outputs);
+        writeArray(file, steps);
+        writeArray(file, checkpoints);
+        writeArray(file, checkpoint_slots);
+        return (bool)file;
     }
 
-    bool handleCopyto(int x, bool animate)
+    // 从文件读取轨迹，文件不完整或内容不一致时返回false
+    bool load(const string &path)
     {
-        if (x < 0)
+        clear();
+        MappedFile file;
+        if (!file.open(path) || file.size < sizeof(TraceHeader))
             return false;
-        if (x >= playground_boxes.size())
+        TraceHeader header;
+        memcpy(&header, file.data, sizeof(header));
+        if (memcmp(header.magic, "HRMT", 4) != 0 || header.version != VERSION || header.interval <= 0 || header.n_playground < 0)
             return false;
-        if (box_taken.isEmpty)
+        if (header.n_steps < 0 || header.n_inputs < 0 || header.n_outputs < 0 || header.n_checkpoints != header.n_steps / header.interval + 1)
             return false;
-
-        if (animate)
+        // 每一项先与剩余的字节数比较再相乘，损坏的头部不会使计算溢出
+        unsigned long long rest = file.size - sizeof(TraceHeader);
+        auto take = [&](long long n, size_t item)
         {
-            goToPlayGround(x);
-        }
+            if ((unsigned long long)n > rest / item)
+                return false;
+            rest -= n * item;
+            return true;
+        };
+        if (!take(header.n_inputs, sizeof(int)) || !take(header.n_outputs, sizeof(int)) || !take(header.n_steps, sizeof(TraceStep)) ||
+            !take(header.n_checkpoints, sizeof(TraceCheckpoint)) || (unsigned long long)header.n_playground > rest / header.n_checkpoints / sizeof(TraceSlot) ||
+            rest != header.n_checkpoints * header.n_playground * sizeof(TraceSlot))
+            return false;
 
-        bool isOccupied = !playground_boxes[x].isEmpty;
-        playground_boxes[x] = box_taken.data;
-        if (isOccupied)
-            box_taken.empty();
+        const char *p = file.data + sizeof(TraceHeader);
+        p = readArray(p, inputs, header.n_inputs);
+        p = readArray(p, outputs, header.n_outputs);
+        p = readArray(p, steps, header.n_steps);
+        p = readArray(p, checkpoints, header.n_checkpoints);
+        readArray(p, checkpoint_slots, header.n_checkpoints * header.n_playground);
+        n_playground = header.n_playground;
+        interval = header.interval;
+        result = (Result)header.result;
+        final_line = header.final_line;
+        fail_index = header.fail_index;
+        fail_value = header.fail_value;
+        loop_detected = header.loop_detected != 0;
 
-        if (animate)
+        // 回放时按下标访问空地、输入与输出，机器人按slot移动，先检查越界
+        long long n_in = 0, n_out = 0;
+        for (const TraceStep &step : steps)
         {
-            delay(step_delay);
-            updateScreen();
+            n_in += (step.flags & IN_POP) != 0;
+            n_out += (step.flags & OUT_PUSH) != 0;
+            if (step.line < 0 || step.op > (unsigned char)CommandId::invalid || step.flags > (HAND_SET | HAND_EMPTY | SLOT_SET | IN_POP | OUT_PUSH) ||
+                step.slot < -1 || step.slot >= n_playground || ((step.flags & SLOT_SET) && step.slot < 0) || n_in > inputs.size() || n_out > outputs.size())
+            {
+                clear();
+                return false;
+            }
+        }
+        for (const TraceCheckpoint &checkpoint : checkpoints)
+        {
+            if (checkpoint.in_pos < 0 || checkpoint.in_pos > inputs.size() || checkpoint.out_size < 0 || checkpoint.out_size > outputs.size())
+            {
+                clear();
+                return false;
+            }
         }
-
         return true;
     }
+};
 
-    bool handleCopyFrom(int x, bool animate)
+// 死循环检测（Brent算法）
+// 在没有输入输出的情况下，若跳转时的机器状态（行号、手中盒子、空地）与之前某次重复，则程序不会停止
+class LoopDetector
+{
+    vector<Box> slots;
+    int pc;
+    Box hand;
+    long long power;
+    long long lam;
+
+public:
+    // 每次输入输出后调用，重新开始检测
+    void reset(int n_playground)
     {
-        if (x < 0)
-            return false;
-        if (x >= playground_boxes.size())
-            return false;
-        if (playground_boxes[x].isEmpty)
-            return false;
-        if (animate)
+        slots.resize(n_playground);
+        pc = -1;
+        power = 1;
+        lam = 0;
+    }
+
+    // 在每次发生跳转后调用
+    // @return 当前状态是否与保存的状态重复
+    bool seen(int line, int hand_data, bool hand_full, const Box *playground)
+    {
+        if (line == pc && hand_full == !hand.isEmpty && (!hand_full || hand_data == hand.data))
         {
-            goToPlayGround(x);
+            bool same = true;
+            for (int i = 0; i < slots.size() && same; i++)
+                same = slots[i].isEmpty == playground[i].isEmpty && slots[i].data == playground[i].data;
+            if (same)
+                return true;
         }
-
-        box_taken = playground_boxes[x];
-
-        if (animate)
+        if (++lam == power)
         {
-            delay(step_delay);
-            updateScreen();
+            pc = line;
+            hand = hand_full ? Box(hand_data) : Box();
+            for (int i = 0; i < slots.size(); i++)
+                slots[i] = playground[i];
+            power *= 2;
+            lam = 0;
         }
+        return false;
+    }
+};
 
-        return true;
+// runFast的输入与运行结果，由Game或Grader准备，指针所指的内存由调用者持有
+struct FastState
+{
+    const Instruction *code;
+    // 每行的分派码，见fuseProgram
+    const unsigned char *op;
+    int n_code;
+    Box *slots;
+    int n_slots;
+    // 运行后指向下一个未取出的输入
+    const int *in_it;
+    const int *in_end;
+    // 输出在第一个与期望不一致处停止，容量至少为n_out + n_expected + 1
+    int *out;
+    int n_out;
+    const int *expected;
+    int n_expected;
+    long long max_steps;
+    LoopDetector *loop_detector;
+    // kProfile、kTrace为真时使用
+    Profile *profile;
+    Trace *trace;
+
+    // 运行结果，含义与Game的同名成员一致
+    long long step_used;
+    int current_line;
+    Box box_taken;
+    int fail_index;
+    int fail_value;
+    bool loop_detected;
+    // 超出max_steps或检测到死循环
+    bool timed_out;
+};
+
+// 无动画的快速执行路径，语义与handle*系列函数一致
+// 手中盒子、空地、行号均保存在局部变量中，GCC下使用computed goto分派
+// 按ops分派，超指令一次执行多步，step_used与逐条执行时完全一致
+// @param kProfile 是否记录性能分析数据，关闭时不产生额外开销
+// @param kTrace 是否记录执行轨迹
+// @param kCommands 关卡允许的指令集合，不在其中的指令已被compileLine记为invalid，其处理代码不会生成
+// @param kSlots 空地数，大于0时空地放在局部的定长数组中，须与state.n_slots一致
+// @return 是否出错，出错时current_line为出错行，超时（state.timed_out）时为下一条将要执行的行
+template <bool kProfile, bool kTrace, unsigned kCommands = ALL_COMMANDS, int kSlots = 0>
+bool runFast(FastState &state)
+{
+    const Instruction *code = state.code;
+    const unsigned char *op = state.op;
+    const int n_code = state.n_code;
+    array<Box, kSlots> fixed_slots;
+    Box *slots = state.slots;
+    if (kSlots > 0)
+    {
+        copy(state.slots, state.slots + kSlots, fixed_slots.begin());
+        slots = fixed_slots.data();
     }
+    const int *in_it = state.in_it;
+    const int *in_end = state.in_end;
+    int *out = state.out;
+    int n_out = state.n_out;
+    const int *expected = state.expected;
+    const int n_expected = state.n_expected;
+    const long long max_steps = state.max_steps;
+    LoopDetector &loop_detector = *state.loop_detector;
+    Profile *profile = state.profile;
+    Trace *trace = state.trace;
+    int hand = 0;
+    bool hand_full = false;
+    long long steps = 0;
+    int pc = 0;
+    bool error = false;
+    bool timed_out = false;
+    loop_detector.reset(state.n_slots);
+    // 连续跳转一次最多合并的jump数
+    const int JUMP_CHAIN_MAX = 8;
 
-    bool handleAdd(int x, bool animate)
+#ifdef __GNUC__
+    static void *dispatch[] = {&&op_inbox, &&op_outbox, &&op_add, &&op_sub, &&op_copyto,
+                               &&op_copyfrom, &&op_jump, &&op_jumpifzero, &&op_invalid,
+                               &&op_load_add_store, &&op_load_sub_store, &&op_load_add, &&op_load_sub,
+                               &&op_add_store, &&op_sub_store, &&op_store_load, &&op_jump_chain};
+#define DISPATCH() goto *dispatch[op[pc]]
+#define DISPATCH_BASE() goto *dispatch[(int)code[pc].id]
+#else
+#define DISPATCH_BASE()                \
+    switch (code[pc].id)               \
+    {                                  \
+    case CommandId::inbox:             \
+        goto op_inbox;                 \
+    case CommandId::outbox:            \
+        goto op_outbox;                \
+    case CommandId::add:               \
+        goto op_add;                   \
+    case CommandId::sub:               \
+        goto op_sub;                   \
+    case CommandId::copyto:            \
+        goto op_copyto;                \
+    case CommandId::copyfrom:          \
+        goto op_copyfrom;              \
+    case CommandId::jump:              \
+        goto op_jump;                  \
+    case CommandId::jumpifzero:        \
+        goto op_jumpifzero;            \
+    default:                           \
+        goto op_invalid;               \
+    }
+#define DISPATCH()                     \
+    switch ((OpCode)op[pc])            \
+    {                                  \
+    case OpCode::load_add_store:       \
+        goto op_load_add_store;        \
+    case OpCode::load_sub_store:       \
+        goto op_load_sub_store;        \
+    case OpCode::load_add:             \
+        goto op_load_add;              \
+    case OpCode::load_sub:             \
+        goto op_load_sub;              \
+    case OpCode::add_store:            \
+        goto op_add_store;             \
+    case OpCode::sub_store:            \
+        goto op_sub_store;             \
+    case OpCode::store_load:           \
+        goto op_store_load;            \
+    case OpCode::jump_chain:           \
+        goto op_jump_chain;            \
+    default:                           \
+        DISPATCH_BASE()                \
+    }
+#endif
+#define NEXT()          \
+    if (++pc >= n_code) \
+        goto halt;      \
+    DISPATCH()
+#define STEP()                \
+    if (steps == max_steps)   \
+        goto timeout;         \
+    steps++;                  \
+    if (kTrace)               \
+        trace->push(pc, code[pc].id); \
+    if (kProfile)             \
+    profile->line_hits[pc]++
+#define TRACE(flags, slot, value) \
+    if (kTrace)                   \
+    trace->set(flags, slot, value)
+#define SLOT_READ()                                 \
+    if (kProfile)                                   \
+    profile->slot_reads[code[pc].arg]++
+// 不在kCommands中的指令不会出现在program中，其处理代码只剩一次跳转
+#define REQUIRE(bits)                   \
+    if ((kCommands & (bits)) != (bits)) \
+    goto op_invalid
+#define JUMP()                                                     \
+    pc = code[pc].arg - 1;                                         \
+    if (loop_detector.seen(pc, hand, hand_full, slots))            \
+        goto loop;                                                 \
+    DISPATCH()
+// 超指令执行n步后前进n行，前提不满足或剩余步数不足时执行该行的普通指令
+#define FUSED(n, ok)                      \
+    if (steps + n > max_steps || !(ok))   \
+        DISPATCH_BASE();                  \
+    steps += n
+#define FUSED_NEXT(n)      \
+    if ((pc += n) >= n_code) \
+        goto halt;         \
+    DISPATCH()
+
+    DISPATCH();
+
+op_inbox:
+    REQUIRE(commandBit(CommandId::inbox));
+    STEP();
+    if (in_it == in_end)
+        goto halt;
+    hand = *in_it++;
+    hand_full = true;
+    TRACE(Trace::IN_POP | Trace::HAND_SET, -1, hand);
+    loop_detector.reset(state.n_slots);
+    NEXT();
+op_outbox:
+    REQUIRE(commandBit(CommandId::outbox));
+    STEP();
+    if (!hand_full)
+        goto fail;
+    if (n_out >= n_expected || expected[n_out] != hand)
     {
-        if (x < 0)
-            return false;
-        if (x >= playground_boxes.size())
-            return false;
-        if (playground_boxes[x].isEmpty)
-            return false;
-        if (box_taken.isEmpty)
-            return false;
+        // 输出不一致时立即停止
+        state.fail_index = n_out;
+        state.fail_value = hand;
+        out[n_out++] = hand;
+        hand_full = false;
+        TRACE(Trace::OUT_PUSH | Trace::HAND_EMPTY, -1, hand);
+        goto halt;
+    }
+    out[n_out++] = hand;
+    hand_full = false;
+    TRACE(Trace::OUT_PUSH | Trace::HAND_EMPTY, -1, hand);
+    loop_detector.reset(state.n_slots);
+    NEXT();
+op_add:
+    REQUIRE(commandBit(CommandId::add));
+    STEP();
+    if (!hand_full || slots[code[pc].arg].isEmpty)
+        goto fail;
+    SLOT_READ();
+    hand += slots[code[pc].arg].data;
+    TRACE(Trace::HAND_SET, code[pc].arg, hand);
+    NEXT();
+op_sub:
+    REQUIRE(commandBit(CommandId::sub));
+    STEP();
+    if (!hand_full || slots[code[pc].arg].isEmpty)
+        goto fail;
+    SLOT_READ();
+    hand -= slots[code[pc].arg].data;
+    TRACE(Trace::HAND_SET, code[pc].arg, hand);
+    NEXT();
+op_copyto:
+{
+    REQUIRE(commandBit(CommandId::copyto));
+    STEP();
+    if (!hand_full)
+        goto fail;
+    Box &slot = slots[code[pc].arg];
+    if (kProfile)
+        profile->slot_writes[code[pc].arg]++;
+    // 与handleCopyto一致：覆盖已有盒子时手中盒子被清空
+    TRACE(slot.isEmpty ? Trace::SLOT_SET : Trace::SLOT_SET | Trace::HAND_EMPTY, code[pc].arg, hand);
+    if (!slot.isEmpty)
+        hand_full = false;
+    slot.data = hand;
+    slot.isEmpty = false;
+    NEXT();
+}
+op_copyfrom:
+    REQUIRE(commandBit(CommandId::copyfrom));
+    STEP();
+    if (slots[code[pc].arg].isEmpty)
+        goto fail;
+    SLOT_READ();
+    hand = slots[code[pc].arg].data;
+    hand_full = true;
+    TRACE(Trace::HAND_SET, code[pc].arg, hand);
+    NEXT();
+op_jump:
+    REQUIRE(commandBit(CommandId::jump));
+    STEP();
+    JUMP();
+op_jumpifzero:
+    REQUIRE(commandBit(CommandId::jumpifzero));
+    STEP();
+    if (!hand_full)
+        goto fail;
+    if (hand == 0)
+    {
+        if (kProfile)
+            profile->jump_taken[pc]++;
+        JUMP();
+    }
+    if (kProfile)
+        profile->jump_not_taken[pc]++;
+    NEXT();
+op_invalid:
+    STEP();
+fail:
+    error = true;
+    goto halt;
 
-        if (animate)
-        {
-            goToPlayGround(x);
-        }
+// 超指令只在不记录性能分析数据与轨迹时出现在ops中
+op_load_add_store:
+op_load_sub_store:
+{
+    REQUIRE(commandBit(CommandId::copyfrom) | commandBit(CommandId::copyto));
+    const Box &a = slots[code[pc].arg];
+    const Box &b = slots[code[pc + 1].arg];
+    FUSED(3, !a.isEmpty && !b.isEmpty);
+    hand = op[pc] == (unsigned char)OpCode::load_add_store ? a.data + b.data : a.data - b.data;
+    Box &c = slots[code[pc + 2].arg];
+    hand_full = c.isEmpty;
+    c.data = hand;
+    c.isEmpty = false;
+    FUSED_NEXT(3);
+}
+op_load_add:
+op_load_sub:
+{
+    REQUIRE(commandBit(CommandId::copyfrom));
+    const Box &a = slots[code[pc].arg];
+    const Box &b = slots[code[pc + 1].arg];
+    FUSED(2, !a.isEmpty && !b.isEmpty);
+    hand = op[pc] == (unsigned char)OpCode::load_add ? a.data + b.data : a.data - b.data;
+    hand_full = true;
+    FUSED_NEXT(2);
+}
+op_add_store:
+op_sub_store:
+{
+    REQUIRE(commandBit(CommandId::copyto));
+    const Box &b = slots[code[pc].arg];
+    FUSED(2, hand_full && !b.isEmpty);
+    hand = op[pc] == (unsigned char)OpCode::add_store ? hand + b.data : hand - b.data;
+    Box &c = slots[code[pc + 1].arg];
+    hand_full = c.isEmpty;
+    c.data = hand;
+    c.isEmpty = false;
+    FUSED_NEXT(2);
+}
+op_store_load:
+{
+    REQUIRE(commandBit(CommandId::copyto) | commandBit(CommandId::copyfrom));
+    // copyto后手中盒子可能被清空，但随即被copyfrom的盒子替换
+    Box &a = slots[code[pc].arg];
+    const Box &b = slots[code[pc + 1].arg];
+    FUSED(2, hand_full && (&a == &b || !b.isEmpty));
+    a.data = hand;
+    a.isEmpty = false;
+    hand = b.data;
+    FUSED_NEXT(2);
+}
+op_jump_chain:
+{
+    REQUIRE(commandBit(CommandId::jump));
+    // 每次跳转后照常检测死循环，与逐条执行时检测的状态与次数相同
+    if (steps + JUMP_CHAIN_MAX > max_steps)
+        DISPATCH_BASE();
+    for (int hop = 1;; hop++)
+    {
+        steps++;
+        pc = code[pc].arg - 1;
+        if (loop_detector.seen(pc, hand, hand_full, slots))
+            goto loop;
+        if (hop == JUMP_CHAIN_MAX || code[pc].id != CommandId::jump)
+            break;
+    }
+    DISPATCH();
+}
 
-        box_taken.data += playground_boxes[x].data;
+loop:
+    state.loop_detected = true;
+timeout:
+    timed_out = true;
+halt:
+#undef FUSED_NEXT
+#undef FUSED
+#undef JUMP
+#undef REQUIRE
+#undef SLOT_READ
+#undef TRACE
+#undef STEP
+#undef NEXT
+#undef DISPATCH
+#undef DISPATCH_BASE
+    if (kSlots > 0)
+        copy(fixed_slots.begin(), fixed_slots.end(), state.slots);
+    state.step_used = steps;
+    state.current_line = pc + 1;
+    state.box_taken = hand_full ? Box(hand) : Box();
+    state.in_it = in_it;
+    state.n_out = n_out;
+    state.timed_out = timed_out;
+    return error;
+}
 
-        if (animate)
-        {
-            delay(step_delay);
-            updateScreen();
-        }
+// 按关卡的指令集合与空地数选出runFast的实例，已有关卡的组合各有专门的实例，其余使用通用实例
+// @param commands 关卡允许的指令集合，见commandMask
+bool runFastSelected(FastState &state, unsigned commands)
+{
+    if ((commands & ~IO_COMMANDS) == 0)
+        return runFast<false, false, IO_COMMANDS>(state);
+    switch (state.n_slots)
+    {
+    case 3:
+        return runFast<false, false, ALL_COMMANDS, 3>(state);
+    case 4:
+        return runFast<false, false, ALL_COMMANDS, 4>(state);
+    default:
+        return runFast<false, false>(state);
+    }
+}
 
-        return true;
+// x86-64下可使用JIT后端
+#if defined(__x86_64__) || defined(_M_X64)
+#define hasJit
+#endif
+
+#ifdef hasJit
+// JIT代码与C++之间交换的运行状态，生成的代码按偏移量访问各成员
+struct JitContext
+{
+    Box *slots;
+    const int *in_it;
+    const int *in_end;
+    int *out_it;           // 输出写入位置
+    const int *expected_it; // 与out_it对应的期望输出
+    const int *expected_end;
+    long long steps;
+    long long max_steps;
+    // 每次输入输出加一，检测死循环前若有变化则先重置检测器
+    long long io_epoch;
+    long long loop_epoch;
+    LoopDetector *loop_detector;
+    int n_playground;
+    int hand;
+    int hand_full;
+    int pc;     // 停止时的行，从0开始
+    int reason; // 停止原因，JitCode::HALT等
+};
+
+// 生成的代码在每次跳转后调用，与快速执行路径中的检测一致
+int jitLoopCheck(JitContext *ctx, int line, int hand, int hand_full)
+{
+    if (ctx->io_epoch != ctx->loop_epoch)
+    {
+        ctx->loop_detector->reset(ctx->n_playground);
+        ctx->loop_epoch = ctx->io_epoch;
     }
+    return ctx->loop_detector->seen(line, hand, hand_full != 0, ctx->slots);
+}
 
-    bool handleSub(int x, bool animate)
+// 将解码后的program编译为x86-64机器码
+// 手中盒子、是否为空、步数、空地基址、输入指针均保存在寄存器中，输出直接写入缓冲区
+// 每条指令先检查步数，再检查与handle*系列函数相同的出错条件，不满足时跳到该行的出口，由C++处理
+class JitCode
+{
+    // 寄存器编号
+    enum
     {
-        if (x < 0)
-            return false;
-        if (x >= playground_boxes.size())
-            return false;
-        if (playground_boxes[x].isEmpty)
-            return false;
-        if (box_taken.isEmpty)
-            return false;
+        RAX = 0,
+        RCX = 1,
+        RDX = 2,
+        RBX = 3, // JitContext
+        RSP = 4,
+        RBP = 5, // 空地基址
+        RSI = 6,
+        RDI = 7,
+        R8 = 8,
+        R9 = 9,
+        R12 = 12, // 步数
+        R13 = 13, // 手中盒子
+        R14 = 14, // 手中是否有盒子
+        R15 = 15, // 输入指针
+    };
+#ifdef isWindows
+    const int ARG[4] = {RCX, RDX, R8, R9};
+    const int FRAME = 40; // 32字节shadow space，并保持16字节对齐
+#else
+    const int ARG[4] = {RDI, RSI, RDX, RCX};
+    const int FRAME = 8;
+#endif
+    const unsigned char JE = 0x4, JNE = 0x5;
 
-        if (animate)
-        {
-            goToPlayGround(x);
-        }
+    // 跳到某行出口的待回填位置
+    struct Exit
+    {
+        int pos;
+        int line;
+        int reason;
+    };
 
-        box_taken.data -= playground_boxes[x].data;
+    // 编译用的缓冲区在多次编译之间保留，重用同一个JitCode时不再申请堆内存
+    vector<unsigned char> buf;
+    vector<int> line_start;
+    // 跳到某行开头的待回填位置
+    vector<pair<int, int>> line_fixups;
+    vector<Exit> exits;
+    vector<int> exit_jumps;
 
-        if (animate)
-        {
-            delay(step_delay);
-            updateScreen();
-        }
+    // 可执行内存，容量按页取整，再次编译时足够则重用
+    unsigned char *code = nullptr;
+    size_t code_capacity = 0;
 
-        return true;
+    void emit(unsigned char b)
+    {
+        buf.push_back(b);
     }
 
-    bool handleJump(int x)
+    void emit32(int v)
     {
-        if (x < 1)
-            return false;
-        if (x > codes.size())
-            return false;
-        current_line = x;
-        return true;
+        for (int i = 0; i < 4; i++)
+            emit((v >> (i * 8)) & 0xff);
     }
 
-    bool handleJumpIfZero(int x, bool &jumped)
+    void emit64(unsigned long long v)
     {
-        jumped = false;
-        if (x < 1)
-            return false;
-        if (x > codes.size())
-            return false;
-        if (box_taken.isEmpty)
-            return false;
+        for (int i = 0; i < 8; i++)
+            emit((v >> (i * 8)) & 0xff);
+    }
 
-        if (box_taken.data == 0)
-        {
-            current_line = x;
-            jumped = true;
-        }
-        return true;
+    // 操作数为[base + disp32]的指令，base不能为rsp或r12
+    void memOp(initializer_list<unsigned char> opcode, bool w, int reg, int base, int disp)
+    {
+        unsigned char rex = 0x40 | (w ? 8 : 0) | (reg & 8 ? 4 : 0) | (base & 8 ? 1 : 0);
+        if (rex != 0x40)
+            emit(rex);
+        for (unsigned char b : opcode)
+            emit(b);
+        emit(0x80 | (reg & 7) << 3 | (base & 7));
+        emit32(disp);
     }
 
-    bool isValidCommand(const string &line, pair<CommandId, int> &command)
+    // 两个操作数均为寄存器的指令
+    void regOp(initializer_list<unsigned char> opcode, bool w, int reg, int rm)
     {
-        char t1[100];
-        char t2[100];
-        char t3[100];
+        unsigned char rex = 0x40 | (w ? 8 : 0) | (reg & 8 ? 4 : 0) | (rm & 8 ? 1 : 0);
+        if (rex != 0x40)
+            emit(rex);
+        for (unsigned char b : opcode)
+            emit(b);
+        emit(0xc0 | (reg & 7) << 3 | (rm & 7));
+    }
 
-        int c = sscanf(line.c_str(), "%s %s %s", t1, t2, t3);
-        if (c <= 0 || c > 2)
-            return false;
-        string cmd(t1);
-        CommandId id = parseStr(cmd);
-        if (id == CommandId::invalid)
-            return false;
-        if (id < CommandId::add && c > 1)
-            return false;
-        if (id >= CommandId::add && c < 2)
+    void movImm32(int reg, int v)
+    {
+        if (reg & 8)
+            emit(0x41);
+        emit(0xb8 + (reg & 7));
+        emit32(v);
+    }
+
+    void movImm64(int reg, unsigned long long v)
+    {
+        emit(0x48 | (reg & 8 ? 1 : 0));
+        emit(0xb8 + (reg & 7));
+        emit64(v);
+    }
+
+    void push(int reg)
+    {
+        if (reg & 8)
+            emit(0x41);
+        emit(0x50 + (reg & 7));
+    }
+
+    void pop(int reg)
+    {
+        if (reg & 8)
+            emit(0x41);
+        emit(0x58 + (reg & 7));
+    }
+
+    // 条件跳转到line行的出口
+    void jccExit(unsigned char cc, int line, int reason)
+    {
+        emit(0x0f);
+        emit(0x80 | cc);
+        exits.push_back({(int)buf.size(), line, reason});
+        emit32(0);
+    }
+
+    void jmpExit(int line, int reason)
+    {
+        emit(0xe9);
+        exits.push_back({(int)buf.size(), line, reason});
+        emit32(0);
+    }
+
+    // 跳转到line行开头
+    void jmpLine(int line)
+    {
+        emit(0xe9);
+        line_fixups.push_back({(int)buf.size(), line});
+        emit32(0);
+    }
+
+    void patch(int pos, int target)
+    {
+        int rel = target - (pos + 4);
+        memcpy(&buf[pos], &rel, 4);
+    }
+
+    // 与STEP一致：步数用尽时超时，否则步数加一
+    void step(int line)
+    {
+        memOp({0x3b}, true, R12, RBX, offsetof(JitContext, max_steps));
+        jccExit(JE, line, TIMEOUT);
+        regOp({0xff}, true, 0, R12);
+    }
+
+    // 跳转到target行，之前检测死循环
+    void jump(int target)
+    {
+        regOp({0x89}, true, RBX, ARG[0]);
+        movImm32(ARG[1], target);
+        regOp({0x89}, false, R13, ARG[2]);
+        regOp({0x89}, false, R14, ARG[3]);
+        movImm64(RAX, (unsigned long long)(uintptr_t)&jitLoopCheck);
+        emit(0xff);
+        emit(0xd0); // call rax
+        regOp({0x85}, false, RAX, RAX);
+        jccExit(JNE, target, LOOP);
+        jmpLine(target);
+    }
+
+    // 空地x的盒子与是否为空
+    static int slotData(int x)
+    {
+        return x * sizeof(Box) + offsetof(Box, data);
+    }
+
+    static int slotEmpty(int x)
+    {
+        return x * sizeof(Box) + offsetof(Box, isEmpty);
+    }
+
+    void compileLine(const Instruction &command, int i, int n_code)
+    {
+        int x = command.arg;
+        step(i);
+        switch (command.id)
+        {
+        case CommandId::inbox:
+            memOp({0x3b}, true, R15, RBX, offsetof(JitContext, in_end));
+            jccExit(JE, i, HALT);
+            memOp({0x8b}, false, R13, R15, 0);
+            regOp({0x83}, true, 0, R15);
+            emit(4);
+            movImm32(R14, 1);
+            memOp({0xff}, true, 0, RBX, offsetof(JitContext, io_epoch));
+            break;
+        case CommandId::outbox:
+            regOp({0x85}, false, R14, R14);
+            jccExit(JE, i, ERROR);
+            // 与期望输出比较，不一致时由C++记录并停止
+            memOp({0x8b}, true, RAX, RBX, offsetof(JitContext, expected_it));
+            memOp({0x3b}, true, RAX, RBX, offsetof(JitContext, expected_end));
+            jccExit(JE, i, MISMATCH);
+            memOp({0x3b}, false, R13, RAX, 0);
+            jccExit(JNE, i, MISMATCH);
+            regOp({0x83}, true, 0, RAX);
+            emit(4);
+            memOp({0x89}, true, RAX, RBX, offsetof(JitContext, expected_it));
+            memOp({0x8b}, true, RAX, RBX, offsetof(JitContext, out_it));
+            memOp({0x89}, false, R13, RAX, 0);
+            regOp({0x83}, true, 0, RAX);
+            emit(4);
+            memOp({0x89}, true, RAX, RBX, offsetof(JitContext, out_it));
+            regOp({0x31}, false, R14, R14);
+            memOp({0xff}, true, 0, RBX, offsetof(JitContext, io_epoch));
+            break;
+        case CommandId::add:
+        case CommandId::sub:
+            regOp({0x85}, false, R14, R14);
+            jccExit(JE, i, ERROR);
+            memOp({0x80}, false, 7, RBP, slotEmpty(x));
+            emit(0);
+            jccExit(JNE, i, ERROR);
+            memOp({(unsigned char)(command.id == CommandId::add ? 0x03 : 0x2b)}, false, R13, RBP, slotData(x));
+            break;
+        case CommandId::copyto:
+            regOp({0x85}, false, R14, R14);
+            jccExit(JE, i, ERROR);
+            // 与handleCopyto一致：覆盖已有盒子时手中盒子被清空
+            memOp({0x0f, 0xb6}, false, R14, RBP, slotEmpty(x));
+            memOp({0x89}, false, R13, RBP, slotData(x));
+            memOp({0xc6}, false, 0, RBP, slotEmpty(x));
+            emit(0);
+            break;
+        case CommandId::copyfrom:
+            memOp({0x80}, false, 7, RBP, slotEmpty(x));
+            emit(0);
+            jccExit(JNE, i, ERROR);
+            memOp({0x8b}, false, R13, RBP, slotData(x));
+            movImm32(R14, 1);
+            break;
+        case CommandId::jump:
+            jump(x - 1);
+            return;
+        case CommandId::jumpifzero:
+        {
+            regOp({0x85}, false, R14, R14);
+            jccExit(JE, i, ERROR);
+            regOp({0x85}, false, R13, R13);
+            // 不为零时执行下一行
+            emit(0x0f);
+            emit(0x80 | JNE);
+            int skip = buf.size();
+            emit32(0);
+            jump(x - 1);
+            patch(skip, buf.size());
+            break;
+        }
+        default:
+            jmpExit(i, ERROR);
+            return;
+        }
+        if (i + 1 >= n_code)
+            jmpExit(n_code, HALT);
+    }
+
+    void release()
+    {
+        if (code == nullptr)
+            return;
+#ifdef isWindows
+        VirtualFree(code, 0, MEM_RELEASE);
+#else
+        munmap(code, code_capacity);
+#endif
+        code = nullptr;
+        code_capacity = 0;
+    }
+
+    // 切换可执行内存的权限，任何时候都不同时可写与可执行
+    bool protect(bool writable)
+    {
+#ifdef isWindows
+        DWORD old_protect;
+        return VirtualProtect(code, code_capacity, writable ? PAGE_READWRITE : PAGE_EXECUTE_READ, &old_protect) != 0;
+#else
+        return mprotect(code, code_capacity, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) == 0;
+#endif
+    }
+
+    // 将buf中的代码放入可执行内存，已有的内存足够大时重用，否则重新分配
+    bool install()
+    {
+        const size_t PAGE = 4096;
+        if (code != nullptr && buf.size() <= code_capacity)
+        {
+            if (!protect(true))
+            {
+                release();
+                return false;
+            }
+        }
+        else
+        {
+            release();
+            size_t size = (buf.size() + PAGE - 1) / PAGE * PAGE;
+#ifdef isWindows
+            void *p = VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+            if (p == nullptr)
+                return false;
+#else
+            void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED)
+                return false;
+#endif
+            code = (unsigned char *)p;
+            code_capacity = size;
+        }
+        memcpy(code, buf.data(), buf.size());
+        if (!protect(false))
+        {
+            release();
+            return false;
+        }
+        return true;
+    }
+
+public:
+    // 停止原因
+    enum
+    {
+        HALT,     // 程序结束或输入耗尽
+        ERROR,    // 该行出错
+        TIMEOUT,  // 步数用尽
+        LOOP,     // 检测到死循环
+        MISMATCH, // 该行输出的盒子与期望不一致，尚未写入输出
+    };
+
+    JitCode() {}
+    JitCode(const JitCode &) = delete;
+    JitCode &operator=(const JitCode &) = delete;
+
+    ~JitCode()
+    {
+        release();
+    }
+
+    // 编译program，无法分配可执行内存时返回false
+    bool compile(const Instruction *program, int n_code)
+    {
+        buf.clear();
+        line_fixups.clear();
+        exits.clear();
+        exit_jumps.clear();
+        line_start.assign(n_code, 0);
+
+        // void run(JitContext *ctx)
+        const int saved[] = {RBX, RBP, R12, R13, R14, R15};
+        for (int reg : saved)
+            push(reg);
+        regOp({0x83}, true, 5, RSP);
+        emit(FRAME);
+        regOp({0x89}, true, ARG[0], RBX);
+        memOp({0x8b}, true, RBP, RBX, offsetof(JitContext, slots));
+        memOp({0x8b}, true, R12, RBX, offsetof(JitContext, steps));
+        memOp({0x8b}, false, R13, RBX, offsetof(JitContext, hand));
+        memOp({0x8b}, false, R14, RBX, offsetof(JitContext, hand_full));
+        memOp({0x8b}, true, R15, RBX, offsetof(JitContext, in_it));
+
+        for (int i = 0; i < n_code; i++)
+        {
+            line_start[i] = buf.size();
+            compileLine(program[i], i, n_code);
+        }
+        for (const pair<int, int> &fixup : line_fixups)
+            patch(fixup.first, line_start[fixup.second]);
+
+        // 各行的出口：记下行号与原因后跳到公共出口
+        for (const Exit &exit : exits)
+        {
+            patch(exit.pos, buf.size());
+            memOp({0xc7}, false, 0, RBX, offsetof(JitContext, pc));
+            emit32(exit.line);
+            memOp({0xc7}, false, 0, RBX, offsetof(JitContext, reason));
+            emit32(exit.reason);
+            emit(0xe9);
+            exit_jumps.push_back(buf.size());
+            emit32(0);
+        }
+        int common_exit = buf.size();
+        memOp({0x89}, true, R12, RBX, offsetof(JitContext, steps));
+        memOp({0x89}, false, R13, RBX, offsetof(JitContext, hand));
+        memOp({0x89}, false, R14, RBX, offsetof(JitContext, hand_full));
+        memOp({0x89}, true, R15, RBX, offsetof(JitContext, in_it));
+        regOp({0x83}, true, 0, RSP);
+        emit(FRAME);
+        for (int k = 5; k >= 0; k--)
+            pop(saved[k]);
+        emit(0xc3);
+        for (int pos : exit_jumps)
+            patch(pos, common_exit);
+        return install();
+    }
+
+    void run(JitContext *ctx) const
+    {
+        ((void (*)(JitContext *))code)(ctx);
+    }
+};
+#endif
+
+// 关卡类， 用来执行关卡部分的主要逻辑以及操作
+class Game
+{
+    void goToPlayGround(int x)
+    {
+        int target_column = 3 + x;
+        while (robot_column < target_column)
+        {
+            delay(step_delay);
+            robot_column += 1;
+            updateScreen();
+        }
+        while (robot_column > target_column)
+        {
+            delay(step_delay);
+            robot_column -= 1;
+            updateScreen();
+        }
+    }
+
+    void goToInBox()
+    {
+        while (robot_column > 3)
+        {
+            delay(step_delay);
+            robot_column -= 1;
+            updateScreen();
+        }
+    }
+
+    void goToOutBox()
+    {
+        while (robot_column < 6)
+        {
+            delay(step_delay);
+            robot_column += 1;
+            updateScreen();
+        }
+    }
+
+    bool handleInbox(bool animate)
+    {
+        if (in_pos >= ori_in.size())
             return false;
-        if (find(available_command.begin(), available_command.end(), id) == available_command.end())
+        if (animate)
+        {
+            goToInBox();
+        }
+
+        box_taken = ori_in[in_pos++];
+
+        if (animate)
+        {
+            delay(step_delay);
+            updateScreen();
+        }
+
+        return true;
+    }
+
+    bool handleOutbox(bool animate)
+    {
+        if (box_taken.isEmpty)
             return false;
-        if (c == 1) // no arg command
+        if (animate)
         {
-            command = {id, 0};
-            return true;
+            goToOutBox();
+        }
+
+        checkOutput(box_taken.data);
+        current_out.push_back(box_taken.data);
+        box_taken.empty();
+
+        if (animate)
+        {
+            delay(step_delay);
+            updateScreen();
         }
-        int arg;
-        c = sscanf(t2, "%d", &arg);
-        if (c == 0)
+
+        return true;
+    }
+
+    bool handleCopyto(int x, bool animate)
+    {
+        if (x < 0)
+            return false;
+        if (x >= playground_boxes.size())
             return false;
-        command = {id, arg};
+        Box hand = box_taken, slot = playground_boxes[x];
+        if (!applyCopyto(hand, slot))
+            return false;
+
+        if (animate)
+        {
+            goToPlayGround(x);
+        }
+
+        box_taken = hand;
+        playground_boxes[x] = slot;
+
+        if (animate)
+        {
+            delay(step_delay);
+            updateScreen();
+        }
+
         return true;
     }
 
-    bool resultMatched()
+    bool handleCopyFrom(int x, bool animate)
     {
-        if (current_out.size() != expected_out.size())
+        if (x < 0)
             return false;
-        else
+        if (x >= playground_boxes.size())
+            return false;
+        Box hand = box_taken;
+        if (!applyCopyfrom(hand, playground_boxes[x]))
+            return false;
+
+        if (animate)
         {
-            auto it1 = current_out.begin();
-            auto it2 = expected_out.begin();
-            while (it1 != current_out.end() && it2 != expected_out.end())
-            {
-                if (*it1 != *it2)
-                    return false;
-                it1++;
-                it2++;
-            }
+            goToPlayGround(x);
+        }
+
+        box_taken = hand;
+
+        if (animate)
+        {
+            delay(step_delay);
+            updateScreen();
         }
+
         return true;
     }
 
-public:
-    // 关卡名字
-    string title;
-    // 是否在本次通关
-    bool passed;
+    bool handleAdd(int x, bool animate)
+    {
+        if (x < 0)
+            return false;
+        if (x >= playground_boxes.size())
+            return false;
+        Box hand = box_taken;
+        if (!applyAdd(hand, playground_boxes[x]))
+            return false;
 
-    // 输入端的盒子
-    list<Box> in_boxes;
-    // 初始时输入端盒子
-    list<Box> ori_in;
-    // 输出端的盒子
-    list<Box> out_boxes;
-    // 空地盒子
-    vector<Box> playground_boxes;
-    // 指令数组
-    vector<string> codes;
-    // 该关卡允许使用的指令数组
-    vector<CommandId> available_command;
-    GameScreen screen;
-    // 期望输出
-    list<int> expected_out;
-    // 当前输出（输出端输出）
-    list<int> current_out;
-    // 当前运行指令行数
-    int current_line;
-    // 动画延迟
-    int step_delay; // ms
-    // 右下方窗口是否显示可使用指令，否则显示当前关卡状态
-    bool logAvailableCommand;
-    // 上次尝试的结果
-    Result prevResult;
-    // 上次尝试的步数
-    int step_used;
+        if (animate)
+        {
+            goToPlayGround(x);
+        }
 
-    Box box_taken;
-    int robot_column;
+        box_taken = hand;
+
+        if (animate)
+        {
+            delay(step_delay);
+            updateScreen();
+        }
+
+        return true;
+    }
+
+    bool handleSub(int x, bool animate)
+    {
+        if (x < 0)
+            return false;
+        if (x >= playground_boxes.size())
+            return false;
+        Box hand = box_taken;
+        if (!applySub(hand, playground_boxes[x]))
+            return false;
+
+        if (animate)
+        {
+            goToPlayGround(x);
+        }
+
+        box_taken = hand;
+
+        if (animate)
+        {
+            delay(step_delay);
+            updateScreen();
+        }
+
+        return true;
+    }
+
+    bool handleJump(int x)
+    {
+        if (x < 1)
+            return false;
+        if (x > codes.size())
+            return false;
+        current_line = x;
+        return true;
+    }
+
+    bool handleJumpIfZero(int x, bool &jumped)
+    {
+        jumped = false;
+        if (x < 1)
+            return false;
+        if (x > codes.size())
+            return false;
+        if (box_taken.isEmpty)
+            return false;
+
+        if (box_taken.data == 0)
+        {
+            current_line = x;
+            jumped = true;
+        }
+        return true;
+    }
+
+    // 将codes逐行解码为program，解析失败的行记为invalid，执行到该行时才报错
+    void compileCode()
+    {
+        program.resize(codes.size());
+        for (int i = 0; i < codes.size(); i++)
+        {
+            const char *line = codes[i].data();
+            program[i] = compileLine(line, line + codes[i].size(), available_command, playground_boxes.size(), codes.size());
+        }
+    }
+
+    // 以当前的运行状态调用runFast，运行后写回
+    // @param select 是否按关卡选出专门的实例，只用于不记录性能分析数据与轨迹时
+    template <bool kProfile, bool kTrace>
+    bool runFastPath(long long max_steps, bool &timed_out, bool select = false)
+    {
+        // 输出在第一个与期望不一致处停止，不会超过期望输出的个数加一
+        int n_out = current_out.size();
+        current_out.resize(n_out + expected_out.size() + 1);
+        FastState state = {};
+        state.code = program.data();
+        state.op = ops.data();
+        state.n_code = program.size();
+        state.slots = playground_boxes.data();
+        state.n_slots = playground_boxes.size();
+        state.in_it = ori_in.data() + in_pos;
+        state.in_end = ori_in.data() + ori_in.size();
+        state.out = current_out.data();
+        state.n_out = n_out;
+        state.expected = expected_out.data();
+        state.n_expected = expected_out.size();
+        state.max_steps = max_steps;
+        state.loop_detector = &loop_detector;
+        state.profile = &profile;
+        state.trace = &trace;
+        state.fail_index = fail_index;
+        state.fail_value = fail_value;
+        state.loop_detected = loop_detected;
+        bool error = select ? runFastSelected(state, commandMask(available_command)) : runFast<kProfile, kTrace>(state);
+
+        current_out.resize(state.n_out);
+        fail_index = state.fail_index;
+        fail_value = state.fail_value;
+        loop_detected = state.loop_detected;
+        timed_out = state.timed_out;
+        step_used = state.step_used;
+        current_line = state.current_line;
+        box_taken = state.box_taken;
+        in_pos = state.in_it - ori_in.data();
+        return error;
+    }
+
+#ifdef hasJit
+    // 使用JIT后端运行，语义与runFast一致
+    // @return 是否编译并运行，无法分配可执行内存时返回false，由调用者改用解释执行
+    bool runJit(long long max_steps, bool &error, bool &timed_out)
+    {
+        JitCode jit_code;
+        if (!jit_code.compile(program.data(), program.size()))
+            return false;
+        loop_detector.reset(playground_boxes.size());
+        // 输出在第一个与期望不一致处停止，不会超过期望输出的个数
+        current_out.resize(expected_out.size());
+        JitContext ctx = {};
+        ctx.slots = playground_boxes.data();
+        ctx.in_it = ori_in.data() + in_pos;
+        ctx.in_end = ori_in.data() + ori_in.size();
+        ctx.out_it = current_out.data();
+        ctx.expected_it = expected_out.data();
+        ctx.expected_end = expected_out.data() + expected_out.size();
+        ctx.max_steps = max_steps;
+        ctx.loop_detector = &loop_detector;
+        ctx.n_playground = playground_boxes.size();
+        jit_code.run(&ctx);
+
+        current_out.resize(ctx.out_it - current_out.data());
+        if (ctx.reason == JitCode::MISMATCH)
+        {
+            // 输出不一致时立即停止
+            fail_index = current_out.size();
+            fail_value = ctx.hand;
+            current_out.push_back(ctx.hand);
+            ctx.hand_full = 0;
+        }
+        error = ctx.reason == JitCode::ERROR;
+        loop_detected = ctx.reason == JitCode::LOOP;
+        timed_out = ctx.reason == JitCode::TIMEOUT || loop_detected;
+        step_used = ctx.steps;
+        current_line = ctx.pc + 1;
+        box_taken = ctx.hand_full ? Box(ctx.hand) : Box();
+        in_pos = ctx.in_it - ori_in.data();
+        return true;
+    }
+#else
+    bool runJit(long long max_steps, bool &error, bool &timed_out)
+    {
+        return false;
+    }
+#endif
+
+    // 逐个检查输出，记录第一个与期望输出不一致（或多出）的位置
+    // @return 该输出是否与期望一致
+    bool checkOutput(int value)
+    {
+        int i = current_out.size();
+        if (i < expected_out.size() && expected_out[i] == value)
+            return true;
+        fail_index = i;
+        fail_value = value;
+        return false;
+    }
+
+    bool resultMatched()
+    {
+        return outputMatched(current_out.data(), current_out.size(), expected_out.data(), expected_out.size());
+    }
+
+public:
+    // 关卡名字
+    string title;
+    // 是否在本次通关
+    bool passed;
+
+    // 初始时输入端盒子
+    vector<int> ori_in;
+    // 输入端读取位置，ori_in[in_pos:]为剩余的输入端盒子
+    int in_pos;
+    // 空地盒子
+    vector<Box> playground_boxes;
+    // 指令数组
+    vector<string> codes;
+    // 解码后的指令数组，与codes逐行对应
+    vector<Instruction> program;
+    // 快速执行路径中program每行的分派码，见fuseProgram
+    vector<unsigned char> ops;
+    // 无动画运行时是否合并常见指令序列（超指令），不影响运行结果与步数
+    bool optimizing;
+    // 无动画且不记录性能分析数据与轨迹时是否编译为本机代码运行，只在x86-64下有效
+    bool jit;
+    // 该关卡允许使用的指令数组
+    vector<CommandId> available_command;
+    GameScreen screen;
+    // 期望输出
+    vector<int> expected_out;
+    // 当前输出（输出端输出），只在末尾追加
+    vector<int> current_out;
+    // 当前运行指令行数
+    int current_line;
+    // 动画延迟
+    int step_delay; // ms
+    // 右下方窗口是否显示可使用指令，否则显示当前关卡状态
+    bool logAvailableCommand;
+    // 上次尝试的结果
+    Result prevResult;
+    // 上次尝试的步数
+    long long step_used;
+    // 最大执行步数
+    long long max_steps;
+    // 参考答案的步数与行数，-1表示没有参考答案
+    long long reference_steps;
+    int reference_size;
+    // 上次超时是否由死循环检测发现
+    bool loop_detected;
+    LoopDetector loop_detector;
+    // 是否在运行时记录性能分析数据
+    bool profiling;
+    // 上次运行的性能分析数据
+    Profile profile;
+    // 无动画运行时是否记录执行轨迹
+    bool tracing;
+    // 上次运行的执行轨迹
+    Trace trace;
+    // 每行是否设有断点，下标从0开始，可能短于codes
+    vector<bool> breakpoints;
+    // 上次失败时第一个错误输出的位置，-1表示无
+    int fail_index;
+    // 上次失败时第一个错误输出的值
+    int fail_value;
+
+    Box box_taken;
+    int robot_column;
+
+    Game(const string &title, const vector<int> &in, const vector<CommandId> &available_command, int n_playground_boxes, const vector<int> &expected_out, long long max_steps = MAX_STEPS)
+    {
+        this->max_steps = max_steps;
+        reference_steps = -1;
+        reference_size = -1;
+        this->title = title;
+        ori_in = in;
+        in_pos = 0;
+        playground_boxes.resize(n_playground_boxes);
+        this->expected_out = expected_out;
+        this->available_command = available_command;
+        robot_column = 3;
+        current_line = -1;
+        step_delay = STEP_DELAY;
+        logAvailableCommand = true;
+        prevResult = Result::idle;
+        step_used = 0;
+        fail_index = -1;
+        fail_value = 0;
+        loop_detected = false;
+        profiling = false;
+        tracing = false;
+        optimizing = true;
+        jit = false;
+        passed = false;
+    }
+
+    // 以目录中的关卡开始，关卡数据复制到本局中
+    explicit Game(const LevelCatalog::Level &level)
+        : Game(level.title, {}, commandList(level.commands), level.n_playground, {}, level.max_steps)
+    {
+        ori_in.assign(level.in, level.in + level.n_in);
+        expected_out.assign(level.expected_out, level.expected_out + level.n_out);
+        reference_steps = level.reference_steps;
+        reference_size = level.reference_size;
+    }
+
+    // 刷新屏幕
+    void updateScreen()
+    {
+        screen.clear();
+        BoxView in_view = {ori_in.data() + in_pos, (int)ori_in.size() - in_pos, false};
+        BoxView out_view = {current_out.data(), (int)current_out.size(), true};
+        const Profile *hits = profiling && !profile.empty() ? &profile : nullptr;
+        screen.draw(in_view, out_view, playground_boxes, codes, current_line, robot_column, box_taken, hits, &breakpoints);
+        if (logAvailableCommand)
+            screen.drawAvailableCommand(available_command);
+        else
+            screen.drawResultBlock(prevResult, step_used, failDetail());
+        vector<string> header = {"Level Information: " + title, ""};
+        vector<string> footer = {"Ori In: " + joinBoxes(ori_in), "Expected Out: " + joinBoxes(expected_out), ""};
+        screen.present(header, footer);
+    }
+
+    // 底部信息一行中的盒子列表，超出屏幕宽度的部分省略，避免折行打乱画面
+    string joinBoxes(const vector<int> &boxes)
+    {
+        string text;
+        for (int i : boxes)
+        {
+            if (text.size() > 80)
+                return text + "...";
+            text += to_string(i) + " ";
+        }
+        return text;
+    }
+
+    // 动画路径中记录一步的性能分析数据，此时current_line尚未改变
+    void profileStep(const Instruction &command)
+    {
+        profile.line_hits[current_line - 1]++;
+        int x = command.arg;
+        switch (command.id)
+        {
+        case CommandId::copyfrom:
+        case CommandId::add:
+        case CommandId::sub:
+            if (!playground_boxes[x].isEmpty && (command.id == CommandId::copyfrom || !box_taken.isEmpty))
+                profile.slot_reads[x]++;
+            break;
+        case CommandId::copyto:
+            if (!box_taken.isEmpty)
+                profile.slot_writes[x]++;
+            break;
+        default:
+            break;
+        }
+    }
+
+    // 跳转后检测是否进入死循环
+    bool loopDetected()
+    {
+        loop_detected = loop_detector.seen(current_line - 1, box_taken.data, !box_taken.isEmpty, playground_boxes.data());
+        return loop_detected;
+    }
+
+    // 失败原因的简短描述
+    string failDetail()
+    {
+        if (prevResult == Result::timeout)
+            return loop_detected ? "Endless loop at line " + to_string(current_line) : "Step limit " + to_string(max_steps);
+        if (prevResult == Result::success && reference_steps > 0)
+            return "Reference: " + to_string(reference_steps) + " steps" + (reference_size > 0 ? ", " + to_string(reference_size) + " lines" : "");
+        if (prevResult != Result::failed || fail_index < 0)
+            return "";
+        string text = "Out #" + to_string(fail_index + 1) + ": ";
+        if (fail_index >= current_out.size())
+            return text + "missing";
+        text += to_string(fail_value);
+        if (fail_index < expected_out.size())
+            return text + ", expect " + to_string(expected_out[fail_index]);
+        return text + ", unexpected";
+    }
+
+    // 将运行状态恢复到第一条指令执行之前
+    void resetState()
+    {
+        step_used = 0;
+        fail_index = -1;
+        loop_detected = false;
+        prevResult = Result::idle;
+        logAvailableCommand = false;
+        current_line = 1;
+        current_out.clear();
+        for (Box &box : playground_boxes)
+            box.empty();
+        box_taken.empty();
+        in_pos = 0;
+    }
+
+    // 按轨迹中的一步改变运行状态，机器人移动到该步操作的位置
+    void applyStep(const TraceStep &step)
+    {
+        if (step.flags & Trace::IN_POP)
+            in_pos++;
+        if (step.flags & Trace::OUT_PUSH)
+            current_out.push_back(step.value);
+        if (step.flags & Trace::SLOT_SET)
+            playground_boxes[step.slot] = step.value;
+        if (step.flags & Trace::HAND_SET)
+            box_taken = step.value;
+        if (step.flags & Trace::HAND_EMPTY)
+            box_taken.empty();
+        step_used++;
+        moveRobot(step);
+    }
+
+    // 机器人移动到轨迹中一步操作的位置
+    void moveRobot(const TraceStep &step)
+    {
+        switch ((CommandId)step.op)
+        {
+        case CommandId::inbox:
+            robot_column = 3;
+            break;
+        case CommandId::outbox:
+            robot_column = 6;
+            break;
+        case CommandId::add:
+        case CommandId::sub:
+        case CommandId::copyto:
+        case CommandId::copyfrom:
+            if (step.slot >= 0)
+                robot_column = 3 + step.slot;
+            break;
+        default:
+            break;
+        }
+    }
+
+    // 将运行状态恢复为轨迹中执行n步之后的状态：从之前最近的检查点开始，重放不超过一个检查点间隔的步数
+    // current_out须为trace.outputs的前缀（即正在回放该轨迹），只补上或截去两者相差的部分
+    void seekTrace(long long n)
+    {
+        n = max(0LL, min(n, (long long)trace.steps.size()));
+        long long k = trace.checkpointBefore(n);
+        const TraceCheckpoint &checkpoint = trace.checkpoints[k];
+        const TraceSlot *slots = trace.slotsOf(k);
+        for (int i = 0; i < playground_boxes.size(); i++)
+            playground_boxes[i] = slots[i].full ? Box(slots[i].data) : Box();
+        box_taken = checkpoint.hand_full ? Box(checkpoint.hand) : Box();
+        in_pos = checkpoint.in_pos;
+        if ((long long)current_out.size() > checkpoint.out_size)
+            current_out.resize(checkpoint.out_size);
+        else
+            current_out.insert(current_out.end(), trace.outputs.begin() + current_out.size(), trace.outputs.begin() + checkpoint.out_size);
+        step_used = k * trace.interval;
+        robot_column = 3;
+        if (step_used > 0)
+            moveRobot(trace.steps[step_used - 1]);
+        while (step_used < n)
+            applyStep(trace.steps[step_used]);
+        current_line = n < trace.steps.size() ? trace.steps[n].line + 1 : trace.final_line;
+    }
+
+    // 重置并且运行所有指令
+    // @param animate 是否呈现运行过程动画
+    // @param step_limit 本次运行的最大步数，不大于0时使用max_steps
+    bool runCode(bool animate, long long step_limit = 0)
+    {
+        compileCode();
+        bool passed = runProgram(animate, step_limit);
+        if (!animate && tracing)
+            finishTrace();
+        return passed;
+    }
+
+    // 为刚记录的轨迹生成检查点，并记下运行结果
+    void finishTrace()
+    {
+        trace.finish(ori_in, playground_boxes.size());
+        trace.result = prevResult;
+        trace.final_line = current_line;
+        trace.fail_index = fail_index;
+        trace.fail_value = fail_value;
+        trace.loop_detected = loop_detected;
+    }
+
+    // 编译当前代码并重置运行状态，之后可用stepProgram逐条执行
+    void beginCode()
+    {
+        compileCode();
+        beginProgram();
+    }
+
+    // 重置运行状态，准备从第一行开始执行program
+    void beginProgram()
+    {
+        resetState();
+        if (profiling)
+            profile.reset(program.size(), playground_boxes.size());
+        trace.clear();
+        loop_detector.reset(playground_boxes.size());
+    }
+
+    // 重置并且运行已解码的program，codes为空时不能使用动画
+    bool runProgram(bool animate, long long step_limit = 0)
+    {
+        if (step_limit <= 0)
+            step_limit = max_steps;
+        beginProgram();
+        if (program.size() == 0)
+        {
+            prevResult = Result::error;
+            return false;
+        }
+        bool error = false, done = false, timed_out = false;
+        if (!animate && jit && !profiling && !tracing && runJit(step_limit, error, timed_out))
+            return finishRun(error, timed_out);
+        if (!animate)
+            ops = fuseProgram(program, optimizing && !profiling && !tracing);
+        if (!animate && tracing)
+            error = profiling ? runFastPath<true, true>(step_limit, timed_out) : runFastPath<false, true>(step_limit, timed_out);
+        else if (!animate && profiling)
+            error = runFastPath<true, false>(step_limit, timed_out);
+        else if (!animate)
+            error = runFastPath<false, false>(step_limit, timed_out, true);
+        while (animate && stepProgram(animate, step_limit, done, error, timed_out))
+            ;
+        return finishRun(error, timed_out);
+    }
+
+    // 逐条执行的路径：执行current_line处的一条指令
+    // @return 是否可以继续执行，程序结束、出错或超时时返回false，并设置对应的标志
+    bool stepProgram(bool animate, long long step_limit, bool &done, bool &error, bool &timed_out)
+    {
+        if (step_used == step_limit)
+        {
+            timed_out = true;
+            return false;
+        }
+        step_used++;
+        const Instruction &command = program[current_line - 1];
+        int arg = command.arg;
+        if (profiling)
+            profileStep(command);
+        switch (command.id)
+        {
+        case CommandId::inbox:
+            done = !handleInbox(animate);
+            loop_detector.reset(playground_boxes.size());
+            break;
+        case CommandId::outbox:
+            error = !handleOutbox(animate);
+            done = fail_index >= 0;
+            loop_detector.reset(playground_boxes.size());
+            break;
+        case CommandId::copyto:
+            error = !handleCopyto(arg, animate);
+            break;
+        case CommandId::copyfrom:
+            error = !handleCopyFrom(arg, animate);
+            break;
+        case CommandId::add:
+            error = !handleAdd(arg, animate);
+            break;
+        case CommandId::sub:
+            error = !handleSub(arg, animate);
+            break;
+        case CommandId::jump:
+            error = !handleJump(arg);
+            if (!error)
+            {
+                timed_out = loopDetected();
+                return !timed_out;
+            }
+            break;
+        case CommandId::jumpifzero:
+            bool jumped;
+            if (profiling && !box_taken.isEmpty)
+                (box_taken.data == 0 ? profile.jump_taken : profile.jump_not_taken)[current_line - 1]++;
+            error = !handleJumpIfZero(arg, jumped);
+            if (jumped)
+            {
+                timed_out = loopDetected();
+                return !timed_out;
+            }
+            break;
+        default:
+            error = true;
+            break;
+        }
+        if (error || timed_out)
+            return false;
+        current_line++;
+        if (current_line > codes.size())
+            done = true;
+        return !done;
+    }
+
+    // 运行停止后根据停止原因与输出得出结果
+    // @return 是否通关
+    bool finishRun(bool error, bool timed_out)
+    {
+        if (error)
+        {
+            prevResult = Result::error;
+            return false;
+        }
+        if (timed_out)
+        {
+            prevResult = Result::timeout;
+            return false;
+        }
+        current_line = -1;
+        if (resultMatched())
+        {
+            prevResult = Result::success;
+            passed = true;
+            return true;
+        }
+        else
+        {
+            if (fail_index < 0)
+                fail_index = current_out.size();
+            prevResult = Result::failed;
+            return false;
+        }
+    }
+
+    // 从file_path文件中加载代码
+    bool importCode(string file_path)
+    {
+        MappedFile file;
+        if (!file.open(file_path))
+            return false;
+        const char *p = file.data;
+        const char *e = file.data + file.size;
+        const char *lb = p, *le = p;
+        int n_command;
+        if (!nextLine(p, e, lb, le) || !parseInt(lb, le, n_command))
+            return false;
+        codes.clear();
+        for (int i = 0; i < n_command; i++)
+        {
+            // 行数不足时与getline一致，补为空行
+            if (!nextLine(p, e, lb, le))
+                lb = le = e;
+            addCode(string(lb, le));
+        }
+        return true;
+    }
+
+    // 对当前代码做静态分析
+    vector<Diagnostic> analyzeCode()
+    {
+        return Analyzer(codes, available_command, playground_boxes.size()).analyze();
+    }
+
+    // 增加一行代码
+    void addCode(string code)
+    {
+        trim(code);
+        codes.push_back(code);
+    }
+
+    // 删除最后一行代码
+    void removeCode()
+    {
+        codes.pop_back();
+    }
+};
+
+// 在构造到析构期间不等待回车、不回显地读取单个按键
+class RawInput
+{
+#ifndef isWindows
+    termios saved;
+    bool active;
+#endif
+
+public:
+    RawInput()
+    {
+#ifndef isWindows
+        active = tcgetattr(STDIN_FILENO, &saved) == 0;
+        if (!active)
+            return;
+        termios raw = saved;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 0;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+#endif
+    }
+
+    ~RawInput()
+    {
+#ifndef isWindows
+        if (active)
+            tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+#endif
+    }
+
+    // @return 按下的键，没有按键时返回-1
+    int poll()
+    {
+#ifdef isWindows
+        return _kbhit() ? _getch() : -1;
+#else
+        char c;
+        if (read(STDIN_FILENO, &c, 1) == 1)
+            return c;
+        return -1;
+#endif
+    }
+};
+
+// 快速回放：先无动画地运行并记录轨迹，再以固定帧率按所选速度回放
+// 每帧前进的步数由速度决定，跳过的中间状态不再绘制；后退时从轨迹的检查点恢复，不再重新运行
+class Playback
+{
+    Game &game;
+    // 回放速度，1x为每STEP_DELAY一步
+    int speed;
+    bool paused;
+    bool quit;
+    // 已经回放的步数
+    long long shown;
+    // 保存轨迹的结果提示
+    string message;
+
+    void advance(long long n)
+    {
+        const vector<TraceStep> &steps = game.trace.steps;
+        for (; n > 0 && shown < steps.size(); n--)
+            game.applyStep(steps[shown++]);
+    }
+
+    void back(long long n)
+    {
+        shown = max(0LL, shown - n);
+        game.seekTrace(shown);
+    }
+
+    void handleKey(int key)
+    {
+        if (key == ' ')
+            paused = !paused;
+        else if (key == 'n')
+        {
+            paused = true;
+            advance(1);
+        }
+        else if (key == 'b')
+        {
+            paused = true;
+            back(1);
+        }
+        else if (key == 'B')
+        {
+            paused = true;
+            back(game.trace.interval);
+        }
+        else if (key == '1')
+            speed = 1;
+        else if (key == '2')
+            speed = 4;
+        else if (key == '3')
+            speed = 16;
+        else if (key == 'f')
+            advance(game.trace.steps.size());
+        else if (key == 'w')
+            message = game.trace.save(TRACE_PATH) ? "trace saved to " + TRACE_PATH : "cannot write " + TRACE_PATH;
+        else if (key == 'q')
+            quit = true;
+    }
+
+    void render()
+    {
+        const vector<TraceStep> &steps = game.trace.steps;
+        game.current_line = shown < steps.size() ? steps[shown].line + 1 : game.trace.final_line;
+        game.updateScreen();
+        cout << "Playback " << speed << "x " << (paused ? "(paused) " : "") << "| step " << shown << "/" << steps.size() << "  " << message << endl;
+        cout << "[space] pause  [n] step  [b/B] back 1/" << game.trace.interval << "  [1] 1x  [2] 4x  [3] 16x  [f] final state  [w] save trace  [q] quit" << endl;
+    }
+
+public:
+    Playback(Game &game) : game(game), speed(1), paused(false), quit(false), shown(0) {}
+
+    // 运行当前代码并回放
+    void run()
+    {
+        game.tracing = true;
+        game.runCode(false);
+        game.tracing = false;
+        replay();
+    }
+
+    // 回放game.trace中已有的轨迹，如从文件读取的轨迹
+    void replay()
+    {
+        long long n_steps = game.trace.steps.size();
+        game.resetState();
+        game.robot_column = 3;
+        RawInput input;
+        double pending = 0;
+        while (!quit && shown < n_steps)
+        {
+            int key;
+            while ((key = input.poll()) >= 0)
+                handleKey(key);
+            if (!paused)
+            {
+                pending += (double)speed * FRAME_DELAY / game.step_delay;
+                long long n = pending;
+                pending -= n;
+                advance(n);
+            }
+            render();
+            delay(FRAME_DELAY);
+        }
+
+        advance(n_steps);
+        game.prevResult = game.trace.result;
+        game.current_line = game.trace.final_line;
+        game.fail_index = game.trace.fail_index;
+        game.fail_value = game.trace.fail_value;
+        game.loop_detected = game.trace.loop_detected;
+        if (game.prevResult == Result::success)
+            game.passed = true;
+    }
+};
+
+// 逐步调试：单步前进、后退、运行到指定行以及断点
+// 前进时每隔SNAPSHOT_INTERVAL步保存一次运行状态，后退时从之前最近的快照重新执行，因此后退的代价不超过该间隔
+class Debugger
+{
+    static const int SNAPSHOT_INTERVAL = 256;
+
+    // 执行step_used步之后的运行状态，输出只在末尾追加，只需记下个数
+    struct Snapshot
+    {
+        long long step_used;
+        int current_line;
+        Box box_taken;
+        vector<Box> playground_boxes;
+        int in_pos;
+        int out_size;
+        int fail_index;
+        int fail_value;
+        LoopDetector loop_detector;
+    };
+
+    Game &game;
+    // snapshots[k]为执行k * SNAPSHOT_INTERVAL步之后的状态
+    vector<Snapshot> snapshots;
+    bool done, error, timed_out;
+    // 运行调试开始前是否开启性能分析，调试期间关闭以免后退时重复计数
+    bool profiling;
+
+    void restore(const Snapshot &snapshot)
+    {
+        game.step_used = snapshot.step_used;
+        game.current_line = snapshot.current_line;
+        game.box_taken = snapshot.box_taken;
+        game.playground_boxes = snapshot.playground_boxes;
+        game.in_pos = snapshot.in_pos;
+        game.current_out.resize(snapshot.out_size);
+        game.fail_index = snapshot.fail_index;
+        game.fail_value = snapshot.fail_value;
+        game.loop_detector = snapshot.loop_detector;
+        game.loop_detected = false;
+        game.prevResult = Result::idle;
+        done = error = timed_out = false;
+    }
+
+    bool atBreakpoint()
+    {
+        int i = game.current_line - 1;
+        return i >= 0 && i < game.breakpoints.size() && game.breakpoints[i];
+    }
+
+public:
+    // 程序是否已经停止
+    bool halted;
+
+    Debugger(Game &game) : game(game), done(false), error(false), timed_out(false), profiling(game.profiling), halted(false)
+    {
+        game.profiling = false;
+    }
+
+    ~Debugger()
+    {
+        game.profiling = profiling;
+    }
+
+    // 编译当前代码并停在第一行之前
+    bool start()
+    {
+        game.beginCode();
+        snapshots.clear();
+        done = error = timed_out = halted = false;
+        if (game.program.empty())
+        {
+            game.prevResult = Result::error;
+            halted = true;
+            return false;
+        }
+        return true;
+    }
+
+    // 前进一步
+    // @param animate 是否呈现该步的动画
+    void forward(bool animate)
+    {
+        if (halted)
+            return;
+        if (game.step_used % SNAPSHOT_INTERVAL == 0 && snapshots.size() == game.step_used / SNAPSHOT_INTERVAL)
+            snapshots.push_back({game.step_used, game.current_line, game.box_taken, game.playground_boxes, game.in_pos,
+                                 (int)game.current_out.size(), game.fail_index, game.fail_value, game.loop_detector});
+        if (!game.stepProgram(animate, game.max_steps, done, error, timed_out))
+        {
+            halted = true;
+            game.finishRun(error, timed_out);
+        }
+    }
+
+    // 后退n步：恢复到之前最近的快照，再无动画地重新执行到目标步数
+    void back(long long n)
+    {
+        if (snapshots.empty())
+            return;
+        long long target = max(0LL, game.step_used - n);
+        restore(snapshots[target / SNAPSHOT_INTERVAL]);
+        halted = false;
+        while (game.step_used < target)
+            game.stepProgram(false, game.max_steps, done, error, timed_out);
+    }
+
+    // 无动画地运行，直到停在断点或line行（至少执行一步），line为0时只停在断点
+    void runTo(int line)
+    {
+        do
+            forward(false);
+        while (!halted && game.current_line != line && !atBreakpoint());
+    }
+
+    void toggleBreakpoint(int line)
+    {
+        if (line < 1 || line > game.codes.size())
+            return;
+        if (game.breakpoints.size() < line)
+            game.breakpoints.resize(line, false);
+        game.breakpoints[line - 1] = !game.breakpoints[line - 1];
+    }
+};
+
+// 同一程序在多组输入上的批量执行，每LANES组输入为一组（group），按相同的控制流同步执行
+// 控制流相同的实例在同一位置上手中盒子与各空地是否为空、已输入与已输出的个数都相同，只需保存一份
+// 只有盒子中的数值按实例存放在定长数组中，逐实例的循环可被编译器向量化（取决于编译选项，如-msse4.1、-mavx2），否则即为标量执行
+// jumpifzero的结果不一致时一组分裂为两组各自继续执行，输入耗尽、输出不符、检测到死循环的实例单独结束
+// 每个实例的结果与以其输入、期望输出构造的Game执行runCode(false)完全一致
+class LaneEngine
+{
+public:
+    static const int LANES = 8;
+
+    // 一个实例的运行结果，含义与Game中的同名成员一致
+    struct LaneResult
+    {
+        Result result = Result::idle;
+        long long step_used = 0;
+        int current_line = 1;
+        bool loop_detected = false;
+        int fail_index = -1;
+        int fail_value = 0;
+        vector<int> out;
+    };
+
+private:
+    typedef array<int, LANES> Lanes;
+
+    struct Group
+    {
+        // 仍在执行的实例，第l位对应id[l]
+        unsigned active;
+        int id[LANES];
+        int pc;
+        long long steps;
+        int in_pos;
+        bool hand_full;
+        Lanes hand;
+        vector<char> slot_full;
+        vector<Lanes> slots;
+        // 死循环检测（与LoopDetector相同的Brent算法），保存的数值按实例存放
+        int saved_pc;
+        bool saved_hand_full;
+        Lanes saved_hand;
+        vector<char> saved_slot_full;
+        vector<Lanes> saved_slots;
+        long long power;
+        long long lam;
+
+        void resetLoop()
+        {
+            saved_pc = -1;
+            power = 1;
+            lam = 0;
+        }
+    };
+
+    const vector<Instruction> &program;
+    int n_playground;
+    long long max_steps;
+    const vector<vector<int>> *inputs;
+    const vector<vector<int>> *expected;
+    vector<LaneResult> *results;
+
+    // 结束g中mask内的实例，与Game::finishRun一致
+    void retire(Group &g, unsigned mask, Result result, int line, bool loop_detected = false)
+    {
+        for (int l = 0; l < LANES; l++)
+        {
+            if (!(mask >> l & 1))
+                continue;
+            LaneResult &r = (*results)[g.id[l]];
+            r.step_used = g.steps;
+            r.current_line = line;
+            r.loop_detected = loop_detected;
+            r.result = result;
+            if (result == Result::idle)
+            {
+                // 正常停止，已有的输出都与期望一致
+                r.current_line = -1;
+                r.result = r.out.size() == (*expected)[g.id[l]].size() ? Result::success : Result::failed;
+                if (r.result == Result::failed && r.fail_index < 0)
+                    r.fail_index = r.out.size();
+            }
+        }
+        g.active &= ~mask;
+    }
+
+    // 在每次跳转后调用，与LoopDetector::seen一致，死循环的实例以超时结束
+    void checkLoop(Group &g)
+    {
+        if (g.pc == g.saved_pc && g.hand_full == g.saved_hand_full && g.slot_full == g.saved_slot_full)
+        {
+            unsigned same = 0;
+            for (int l = 0; l < LANES; l++)
+            {
+                bool eq = !g.hand_full || g.hand[l] == g.saved_hand[l];
+                for (int k = 0; k < n_playground; k++)
+                    eq = eq && (!g.slot_full[k] || g.slots[k][l] == g.saved_slots[k][l]);
+                same |= (unsigned)eq << l;
+            }
+            if (same & g.active)
+                retire(g, same & g.active, Result::timeout, g.pc + 1, true);
+        }
+        if (++g.lam == g.power)
+        {
+            g.saved_pc = g.pc;
+            g.saved_hand_full = g.hand_full;
+            g.saved_hand = g.hand;
+            g.saved_slot_full = g.slot_full;
+            g.saved_slots = g.slots;
+            g.power *= 2;
+            g.lam = 0;
+        }
+    }
+
+    // 执行一组直到其中所有实例结束，分裂出的组放入pending
+    void runGroup(Group &g, vector<Group> &pending)
+    {
+        const int n_code = program.size();
+        while (g.active)
+        {
+            if (g.pc >= n_code)
+            {
+                retire(g, g.active, Result::idle, -1);
+                break;
+            }
+            if (g.steps == max_steps)
+            {
+                retire(g, g.active, Result::timeout, g.pc + 1);
+                break;
+            }
+            g.steps++;
+            const Instruction &command = program[g.pc];
+            int x = command.arg;
+            bool error = false;
+            switch (command.id)
+            {
+            case CommandId::inbox:
+            {
+                unsigned exhausted = 0;
+                for (int l = 0; l < LANES; l++)
+                {
+                    if (!(g.active >> l & 1))
+                        continue;
+                    const vector<int> &in = (*inputs)[g.id[l]];
+                    if (g.in_pos < in.size())
+                        g.hand[l] = in[g.in_pos];
+                    else
+                        exhausted |= 1u << l;
+                }
+                if (exhausted)
+                    retire(g, exhausted, Result::idle, -1);
+                g.in_pos++;
+                g.hand_full = true;
+                g.resetLoop();
+                g.pc++;
+                break;
+            }
+            case CommandId::outbox:
+            {
+                if (!g.hand_full)
+                {
+                    error = true;
+                    break;
+                }
+                // 与checkOutput一致：第一个不符合的输出即判定失败
+                unsigned mismatched = 0;
+                for (int l = 0; l < LANES; l++)
+                {
+                    if (!(g.active >> l & 1))
+                        continue;
+                    LaneResult &r = (*results)[g.id[l]];
+                    const vector<int> &exp = (*expected)[g.id[l]];
+                    int i = r.out.size();
+                    if (i >= exp.size() || exp[i] != g.hand[l])
+                    {
+                        r.fail_index = i;
+                        r.fail_value = g.hand[l];
+                        mismatched |= 1u << l;
+                    }
+                    r.out.push_back(g.hand[l]);
+                }
+                if (mismatched)
+                    retire(g, mismatched, Result::failed, -1);
+                g.hand_full = false;
+                g.resetLoop();
+                g.pc++;
+                break;
+            }
+            case CommandId::add:
+                error = !g.hand_full || !g.slot_full[x];
+                if (error)
+                    break;
+                for (int l = 0; l < LANES; l++)
+                    g.hand[l] += g.slots[x][l];
+                g.pc++;
+                break;
+            case CommandId::sub:
+                error = !g.hand_full || !g.slot_full[x];
+                if (error)
+                    break;
+                for (int l = 0; l < LANES; l++)
+                    g.hand[l] -= g.slots[x][l];
+                g.pc++;
+                break;
+            case CommandId::copyto:
+                error = !g.hand_full;
+                if (error)
+                    break;
+                // 与handleCopyto一致：覆盖已有盒子时手中盒子被清空
+                g.slots[x] = g.hand;
+                g.hand_full = !g.slot_full[x];
+                g.slot_full[x] = true;
+                g.pc++;
+                break;
+            case CommandId::copyfrom:
+                error = !g.slot_full[x];
+                if (error)
+                    break;
+                g.hand = g.slots[x];
+                g.hand_full = true;
+                g.pc++;
+                break;
+            case CommandId::jump:
+                g.pc = x - 1;
+                checkLoop(g);
+                break;
+            case CommandId::jumpifzero:
+            {
+                if (!g.hand_full)
+                {
+                    error = true;
+                    break;
+                }
+                unsigned zero = 0;
+                for (int l = 0; l < LANES; l++)
+                    zero |= (unsigned)(g.hand[l] == 0) << l;
+                zero &= g.active;
+                if (zero != g.active && zero != 0)
+                {
+                    // 不跳转的实例分裂为新的一组，从下一行继续
+                    pending.push_back(g);
+                    pending.back().active = g.active & ~zero;
+                    pending.back().pc++;
+                    g.active = zero;
+                }
+                if (zero)
+                {
+                    g.pc = x - 1;
+                    checkLoop(g);
+                }
+                else
+                    g.pc++;
+                break;
+            }
+            default:
+                error = true;
+                break;
+            }
+            if (error)
+            {
+                // 出错时状态不再使用，current_line为出错行
+                retire(g, g.active, Result::error, g.pc + 1);
+                break;
+            }
+        }
+    }
+
+public:
+    // @param program 已由compileLine解码的程序
+    LaneEngine(const vector<Instruction> &program, int n_playground, long long max_steps = MAX_STEPS)
+        : program(program), n_playground(n_playground), max_steps(max_steps) {}
+
+    // 对每组输入与期望输出运行程序
+    // @return 与inputs一一对应的结果
+    vector<LaneResult> run(const vector<vector<int>> &inputs, const vector<vector<int>> &expected)
+    {
+        vector<LaneResult> lane_results(inputs.size());
+        this->inputs = &inputs;
+        this->expected = &expected;
+        results = &lane_results;
+        if (program.empty())
+        {
+            for (LaneResult &r : lane_results)
+                r.result = Result::error;
+            return lane_results;
+        }
+        vector<Group> pending;
+        for (int begin = 0; begin < inputs.size(); begin += LANES)
+        {
+            Group g;
+            g.active = 0;
+            for (int l = 0; l < LANES; l++)
+            {
+                g.id[l] = begin + l < inputs.size() ? begin + l : begin;
+                if (begin + l < inputs.size())
+                    g.active |= 1u << l;
+            }
+            g.pc = 0;
+            g.steps = 0;
+            g.in_pos = 0;
+            g.hand_full = false;
+            g.hand.fill(0);
+            g.slot_full.assign(n_playground, false);
+            g.slots.assign(n_playground, Lanes());
+            g.saved_slots.assign(n_playground, Lanes());
+            g.resetLoop();
+            pending.push_back(g);
+            while (!pending.empty())
+            {
+                Group current = pending.back();
+                pending.pop_back();
+                runGroup(current, pending);
+            }
+        }
+        return lane_results;
+    }
+};
+
+// 所有关卡的数据，编译期可用，levelInfo由此生成
+constexpr ConstLevel LEVEL_DATA[] = {
+    {"level 1 - the basic",
+     2, {1, 2},
+     2, {1, 2},
+     2, {CommandId::inbox, CommandId::outbox},
+     0},
+    {"level 2 - tricky part",
+     8, {3, 9, 5, 1, -2, -2, 9, -9},
+     8, {-6, 6, 4, -4, 0, 0, 18, -18},
+     8, {CommandId::inbox, CommandId::outbox, CommandId::add, CommandId::sub, CommandId::copyto, CommandId::copyfrom, CommandId::jump, CommandId::jumpifzero},
+     3},
+    {"level 3 - the twin",
+     8, {6, 2, 7, 7, -9, 3, -3, -3},
+     2, {7, -3},
+     8, {CommandId::inbox, CommandId::outbox, CommandId::add, CommandId::sub, CommandId::copyto, CommandId::copyfrom, CommandId::jump, CommandId::jumpifzero},
+     3},
+    {"level 4 - fib number",
+     1, {1},
+     4, {1, 1, 2, 3},
+     8, {CommandId::inbox, CommandId::outbox, CommandId::add, CommandId::sub, CommandId::copyto, CommandId::copyfrom, CommandId::jump, CommandId::jumpifzero},
+     4},
+};
+const int N_LEVEL = sizeof(LEVEL_DATA) / sizeof(LEVEL_DATA[0]);
+
+// 各关卡的参考答案，与src/ans1-4.txt相同
+constexpr const char *REFERENCE_SOLUTION[N_LEVEL] = {
+    "4\ninbox\noutbox\ninbox\noutbox\n",
+    "11\ninbox\ncopyto 0\ninbox\ncopyto 1\ncopyfrom 0\nsub 1\noutbox\ncopyfrom 1\nsub 0\noutbox\njump 1\n",
+    "11\ninbox\ncopyto 0\ninbox\ncopyto 1\ncopyfrom 1\nsub 0\njumpifzero 9\njump 1\ncopyfrom 0\noutbox\njump 1\n",
+    "16\ninbox\ncopyto 0\ncopyfrom 0\ncopyto 1\ncopyfrom 0\noutbox\ncopyfrom 1\noutbox\ncopyfrom 1\nadd 0\n"
+    "copyto 0\ncopyfrom 0\noutbox\ncopyfrom 0\nadd 1\noutbox\n",
+};
+
+// 参考答案在编译期运行的结果
+constexpr ConstResult REFERENCE_RESULT[N_LEVEL] = {
+    constRun(LEVEL_DATA[0], constCompile(LEVEL_DATA[0], REFERENCE_SOLUTION[0])),
+    constRun(LEVEL_DATA[1], constCompile(LEVEL_DATA[1], REFERENCE_SOLUTION[1])),
+    constRun(LEVEL_DATA[2], constCompile(LEVEL_DATA[2], REFERENCE_SOLUTION[2])),
+    constRun(LEVEL_DATA[3], constCompile(LEVEL_DATA[3], REFERENCE_SOLUTION[3])),
+};
+
+// 关卡数据或执行语义改动后，参考答案必须仍然通关，步数变化时需同时确认后更新这里
+static_assert(REFERENCE_RESULT[0].result == Result::success && REFERENCE_RESULT[0].steps == 4, "reference solution of level 1");
+static_assert(REFERENCE_RESULT[1].result == Result::success && REFERENCE_RESULT[1].steps == 45, "reference solution of level 2");
+static_assert(REFERENCE_RESULT[2].result == Result::success && REFERENCE_RESULT[2].steps == 37, "reference solution of level 3");
+static_assert(REFERENCE_RESULT[3].result == Result::success && REFERENCE_RESULT[3].steps == 16, "reference solution of level 4");
+
+// 参考答案的行数
+constexpr int REFERENCE_SIZE[N_LEVEL] = {
+    constCompile(LEVEL_DATA[0], REFERENCE_SOLUTION[0]).n_code,
+    constCompile(LEVEL_DATA[1], REFERENCE_SOLUTION[1]).n_code,
+    constCompile(LEVEL_DATA[2], REFERENCE_SOLUTION[2]).n_code,
+    constCompile(LEVEL_DATA[3], REFERENCE_SOLUTION[3]).n_code,
+};
+
+// 以GameInfo表示目录中的一个关卡，数据复制到其中
+GameInfo levelGameInfo(const LevelCatalog::Level &level)
+{
+    GameInfo info;
+    info.title = level.title;
+    info.in.assign(level.in, level.in + level.n_in);
+    info.expected_out.assign(level.expected_out, level.expected_out + level.n_out);
+    info.available_command = commandList(level.commands);
+    info.n_playground = level.n_playground;
+    info.max_steps = level.max_steps;
+    info.reference_steps = level.reference_steps;
+    info.reference_size = level.reference_size;
+    return info;
+}
+
+// 内置关卡的数据，也是转换为关卡包时的来源
+vector<GameInfo> builtinLevels()
+{
+    vector<GameInfo> levels(N_LEVEL);
+    for (int i = 0; i < N_LEVEL; i++)
+    {
+        const ConstLevel &data = LEVEL_DATA[i];
+        GameInfo &info = levels[i];
+        info.title = data.title;
+        info.in.assign(data.in, data.in + data.n_in);
+        info.expected_out.assign(data.expected_out, data.expected_out + data.n_out);
+        info.available_command.assign(data.available_command, data.available_command + data.n_command);
+        info.n_playground = data.n_playground;
+        info.reference_steps = REFERENCE_RESULT[i].steps;
+        info.reference_size = REFERENCE_SIZE[i];
+    }
+    return levels;
+}
+
+// 内置关卡的目录，第一次调用时生成，之后只读
+const LevelCatalog &builtinCatalog()
+{
+    static const LevelCatalog catalog(builtinLevels());
+    return catalog;
+}
+
+// 由useLevelPack打开的关卡包，为空时使用内置关卡
+LevelCatalog *levelPack = nullptr;
+
+// 在启动时、开始评测之前调用，之后levelCatalog返回该关卡包，关卡包在程序结束前一直有效
+bool useLevelPack(const string &path, string &error)
+{
+    LevelCatalog *pack = new LevelCatalog();
+    if (!pack->open(path, error))
+    {
+        delete pack;
+        return false;
+    }
+    levelPack = pack;
+    return true;
+}
+
+// 评测使用的关卡目录：指定了关卡包时为关卡包，否则为内置关卡
+const LevelCatalog &levelCatalog()
+{
+    return levelPack != nullptr ? *levelPack : builtinCatalog();
+}
+
+// 内置关卡的信息与通关记录，供界面和需要修改关卡数据的工具使用
+vector<GameInfo> levelInfo;
+
+// 带CLI进入关卡页面
+// @return 该关卡是否通关（与之前是否通关无关）
+bool playLevel(const LevelCatalog::Level &level, string fname)
+{
+    Game game(level);
+    if (fname.size() > 0)
+        game.importCode(fname);
+    game.updateScreen();
+
+    while (true)
+    {
+        game.updateScreen();
+        string line;
+        cout << "Enter the command: ( 'r' for run / 't' for turbo run / 'd' for debug / 'v' for verify / 'l' for load trace / 'a' for add / 'i' for import / 'p' for profile on/off / 'q' for quit ) \n> ";
+        getline(cin, line);
+        if (line.compare("r") == 0)
+            game.runCode(true);
+        else if (line.compare("t") == 0)
+        {
+            // 快速回放模式
+            Playback playback(game);
+            playback.run();
+        }
+        else if (line.compare("d") == 0)
+        {
+            // 逐步调试模式
+            Debugger debugger(game);
+            debugger.start();
+            while (true)
+            {
+                game.updateScreen();
+                cout << "Debug Mode: ('s' step / 'b' step back / 'g N' run to line N / 'k N' toggle breakpoint on line N / 'c' continue / 'q' quit)\n> ";
+                getline(cin, line);
+                int arg = 0;
+                char c = line.empty() ? 0 : line[0];
+                bool has_arg = sscanf(line.c_str() + (line.empty() ? 0 : 1), "%d", &arg) == 1;
+                if (c == 'q')
+                    break;
+                else if (c == 's')
+                    debugger.forward(true);
+                else if (c == 'b')
+                    debugger.back(1);
+                else if (c == 'g' && has_arg)
+                    debugger.runTo(arg);
+                else if (c == 'k' && has_arg)
+                    debugger.toggleBreakpoint(arg);
+                else if (c == 'c')
+                    debugger.runTo(0);
+            }
+        }
+        else if (line.compare("l") == 0)
+        {
+            // 回放之前保存的轨迹，轨迹须来自同一关卡
+            game.updateScreen();
+            cout << "Enter the trace file path: (q to quit)\n> ";
+            string file_path;
+            getline(cin, file_path);
+            if (file_path.compare("q") == 0)
+                continue;
+            if (!game.trace.load(file_path) || game.trace.inputs != game.ori_in || game.trace.n_playground != game.playground_boxes.size())
+            {
+                game.trace.clear();
+                cout << "Cannot load a trace of this level from file " << file_path << endl;
+                delay(500);
+                continue;
+            }
+            Playback playback(game);
+            playback.replay();
+        }
+        else if (line.compare("v") == 0)
+        {
+            // 静态检查代码，不运行
+            vector<Diagnostic> diagnostics = game.analyzeCode();
+            if (diagnostics.empty())
+                cout << "No problems found." << endl;
+            for (const Diagnostic &diagnostic : diagnostics)
+                cout << diagnostic.toString() << endl;
+            cout << "Press Enter to continue" << endl;
+            getline(cin, line);
+            game.screen.invalidate();
+        }
+        else if (line.compare("p") == 0)
+            game.profiling = !game.profiling;
+        else if (line.compare("q") == 0)
+            break;
+        else if (line.compare("a") == 0)
+        {
+            // 手动上传指令模式
+            game.logAvailableCommand = true;
+            while (true)
+            {
+                game.updateScreen();
+                cout << "Add Code Mode: (input \'q\' if done, \'d\' for delete, \'c\' for clear)\n> ";
+                int arg = 0;
+                getline(cin, line);
+                if (line.compare("q") == 0)
+                {
+                    game.logAvailableCommand = false;
+                    break;
+                }
+                if (line.compare("d") == 0)
+                {
+                    game.removeCode();
+                    continue;
+                }
+                if (line.compare("c") == 0)
+                {
+                    game.codes.clear();
+                    continue;
+                }
+                game.addCode(line);
+            }
+        }
+        else if (line.compare("i") == 0)
+        {
+            // 从文件加载指令模式
+            game.updateScreen();
+            cout << "Enter the file path: (q to quit)\n> ";
+            string file_path;
+            getline(cin, file_path);
+            if (file_path.compare("q") == 0)
+                continue;
+            bool success = game.importCode(file_path);
+            if (!success)
+            {
+                cout << "Cannot import code from file " << file_path << endl;
+                delay(500);
+            }
+        }
+    }
+    return game.passed;
+}
+
+// 将每个游戏是否已通过的信息存入db文件中
+void save2Db()
+{
+    ofstream db(dbPath);
+    for (int i = 0; i < levelInfo.size(); i++)
+    {
+        db << levelInfo[i]._done ? 1 : 0;
+        db << "\n";
+    }
+    db.flush();
+    db.close();
+}
+
+// 从db文件中加载每个关卡的通关信息
+void loadFromDb()
+{
+    ifstream db(dbPath);
+    string line;
+    int i = 0;
+    while (i < levelInfo.size() && getline(db, line))
+    {
+        int n;
+        sscanf(line.c_str(), "%d", &n);
+        levelInfo[i++]._done = n > 0;
+    }
+    db.close();
+}
+
+// 初始化各个关卡信息
+void initGameInfo()
+{
+    const LevelCatalog &catalog = builtinCatalog();
+    levelInfo.clear();
+    for (int i = 0; i < catalog.size(); i++)
+        levelInfo.push_back(levelGameInfo(catalog.level(i)));
+}
+
+// 按块申请的线性分配器：alloc从当前块中依次切出内存，reset后从第一块起重复使用
+// 块只增不减，分配的模式稳定之后不再申请堆内存；不调用析构函数，只用于存放无需析构的数据
+class Arena
+{
+    static const size_t BLOCK_SIZE = 16 << 10;
+    static const size_t ALIGN = alignof(max_align_t);
+
+    struct Block
+    {
+        char *data;
+        size_t size;
+    };
+    vector<Block> blocks;
+    size_t block = 0;
+    size_t used = 0;
+
+public:
+    Arena() = default;
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    ~Arena()
+    {
+        for (const Block &b : blocks)
+            delete[] b.data;
+    }
+
+    // 释放全部分配，块留待下次使用
+    void reset()
+    {
+        block = 0;
+        used = 0;
+    }
+
+    // @return 可存放n个T的未初始化内存
+    template <class T>
+    T *alloc(size_t n)
+    {
+        size_t size = (n * sizeof(T) + ALIGN - 1) / ALIGN * ALIGN;
+        while (block < blocks.size() && used + size > blocks[block].size)
+        {
+            block++;
+            used = 0;
+        }
+        if (block == blocks.size())
+        {
+            size_t block_size = size > BLOCK_SIZE ? size : BLOCK_SIZE;
+            blocks.push_back({new char[block_size], block_size});
+        }
+        T *p = reinterpret_cast<T *>(blocks[block].data + used);
+        used += size;
+        return p;
+    }
+};
+
+// 评测用的轻量执行上下文，无动画地运行一次提交，结果与Game::runCode(false)一致
+// 关卡数据按引用共享，运行状态取自当前线程的Arena，不构造GameScreen等界面相关的成员
+// 稳定之后每次评测不申请堆内存，可在多个线程中同时使用各自的Grader
+class Grader
+{
+    LevelCatalog::Level level;
+
+    static Arena &threadArena()
+    {
+        static thread_local Arena arena;
+        return arena;
+    }
+
+    static LoopDetector &threadLoopDetector()
+    {
+        static thread_local LoopDetector loop_detector;
+        return loop_detector;
+    }
+
+#ifdef hasJit
+    // 编译缓冲区与可执行内存在同一线程的各次评测之间重用
+    static JitCode &threadJitCode()
+    {
+        static thread_local JitCode jit_code;
+        return jit_code;
+    }
+#endif
+
+public:
+    struct Verdict
+    {
+        Result result;
+        long long step_used;
+        // 出错时为出错行，超时时为下一条将要执行的行，运行完毕时为-1
+        int current_line;
+    };
+
+    // @param level 评测期间须保持有效，见LevelCatalog::level与levelView
+    explicit Grader(const LevelCatalog::Level &level) : level(level) {}
+
+    explicit Grader(const GameInfo &info) : level(levelView(info)) {}
+
+    // 运行已由compileLine解码的程序
+    // @param jit 是否使用JIT后端，无法分配可执行内存时改用解释执行
+    Verdict run(const Instruction *program, int n_code, bool jit = false)
+    {
+        Arena &arena = threadArena();
+        arena.reset();
+        return execute(arena, program, n_code, jit);
+    }
+
+    // 解码codes后运行，解码的结果也放在Arena中
+    Verdict run(const vector<string> &codes, bool jit = false)
+    {
+        Arena &arena = threadArena();
+        arena.reset();
+        int n_code = codes.size();
+        Instruction *program = arena.alloc<Instruction>(n_code);
+        for (int i = 0; i < n_code; i++)
+        {
+            const char *line = codes[i].data();
+            program[i] = compileLine(line, line + codes[i].size(), level.commands, level.n_playground, n_code);
+        }
+        return execute(arena, program, n_code, jit);
+    }
+
+private:
+    Verdict execute(Arena &arena, const Instruction *program, int n_code, bool jit)
+    {
+        if (n_code == 0)
+            return {Result::error, 0, 1};
+        Box *slots = arena.alloc<Box>(level.n_playground);
+        for (int i = 0; i < level.n_playground; i++)
+            new (slots + i) Box();
+#ifdef hasJit
+        if (jit && threadJitCode().compile(program, n_code))
+            return executeJit(threadJitCode(), slots, arena.alloc<int>(level.n_out));
+#endif
+        unsigned char *ops = arena.alloc<unsigned char>(n_code);
+        fuseProgram(program, n_code, true, ops);
+
+        FastState state = {};
+        state.code = program;
+        state.op = ops;
+        state.n_code = n_code;
+        state.slots = slots;
+        state.n_slots = level.n_playground;
+        state.in_it = level.in;
+        state.in_end = level.in + level.n_in;
+        state.out = arena.alloc<int>(level.n_out + 1);
+        state.expected = level.expected_out;
+        state.n_expected = level.n_out;
+        state.max_steps = level.max_steps;
+        state.loop_detector = &threadLoopDetector();
+        state.fail_index = -1;
+        bool error = runFastSelected(state, level.commands);
+
+        // 与Game::finishRun一致，运行完毕时行号记为-1
+        if (error)
+            return {Result::error, state.step_used, state.current_line};
+        if (state.timed_out)
+            return {Result::timeout, state.step_used, state.current_line};
+        bool matched = state.fail_index < 0 && state.n_out == state.n_expected;
+        return {matched ? Result::success : Result::failed, state.step_used, -1};
+    }
+
+#ifdef hasJit
+    // 与Game::runJit一致，输出只写入out，不超过期望输出的个数
+    Verdict executeJit(const JitCode &jit_code, Box *slots, int *out)
+    {
+        LoopDetector &loop_detector = threadLoopDetector();
+        loop_detector.reset(level.n_playground);
+        JitContext ctx = {};
+        ctx.slots = slots;
+        ctx.in_it = level.in;
+        ctx.in_end = level.in + level.n_in;
+        ctx.out_it = out;
+        ctx.expected_it = level.expected_out;
+        ctx.expected_end = level.expected_out + level.n_out;
+        ctx.max_steps = level.max_steps;
+        ctx.loop_detector = &loop_detector;
+        ctx.n_playground = level.n_playground;
+        jit_code.run(&ctx);
+
+        if (ctx.reason == JitCode::ERROR)
+            return {Result::error, ctx.steps, ctx.pc + 1};
+        if (ctx.reason == JitCode::TIMEOUT || ctx.reason == JitCode::LOOP)
+            return {Result::timeout, ctx.steps, ctx.pc + 1};
+        bool matched = ctx.reason != JitCode::MISMATCH && ctx.expected_it == ctx.expected_end;
+        return {matched ? Result::success : Result::failed, ctx.steps, -1};
+    }
+#endif
+};
+
+// 评测结果的文字描述
+// @param line 出错时的出错行
+string resultText(Result result, int line)
+{
+    if (result == Result::error)
+        return "Error on instruction " + to_string(line);
+    else if (result == Result::failed)
+        return "Fail";
+    else if (result == Result::timeout)
+        return "Timeout";
+    else
+        return "Success";
+}
+
+string judgeResult(const Game &game)
+{
+    return resultText(game.prevResult, game.current_line);
+}
+
+// 无动画地运行一次提交，返回评测结果（不含换行）
+// 只读取level，可在多个线程中同时调用
+string judge(const LevelCatalog::Level &level, const vector<string> &codes)
+{
+    Grader::Verdict verdict = Grader(level).run(codes);
+    return resultText(verdict.result, verdict.current_line);
+}
+
+// 运行已由compileLine解码的一次提交
+// @param jit 是否使用JIT后端，适合运行步数很多的提交
+string judge(const LevelCatalog::Level &level, const Instruction *program, int n_code, bool jit = false)
+{
+    Grader::Verdict verdict = Grader(level).run(program, n_code, jit);
+    return resultText(verdict.result, verdict.current_line);
+}
+
+string judge(const GameInfo &info, const vector<string> &codes)
+{
+    return judge(levelView(info), codes);
+}
+
+string judge(const GameInfo &info, const Instruction *program, int n_code, bool jit = false)
+{
+    return judge(levelView(info), program, n_code, jit);
+}
+
+// 用于测试代码正确性，无CLI和互动
+// @param profile_format 为"text"或"json"时在结果后输出性能分析报告
+// @param trace_path 不为空时将执行轨迹写入该文件
+// @param analyze 是否在结果后输出静态分析结果
+void simulate(GameInfo &info, string profile_format = "", string trace_path = "", bool analyze = false)
+{
+    vector<string> codes;
+    string line;
+    int n_op = 0;
+    getline(cin, line);
+    sscanf(line.c_str(), "%d", &n_op);
+    for (int i = 1; i <= n_op; i++)
+    {
+        getline(cin, line);
+        codes.push_back(line);
+    }
+    if (analyze)
+    {
+        cout << judge(info, codes) << endl;
+        Game game(info.title, info.in, info.available_command, info.n_playground, info.expected_out, info.max_steps);
+        for (const string &code : codes)
+            game.addCode(code);
+        for (const Diagnostic &diagnostic : game.analyzeCode())
+            cout << diagnostic.toString() << endl;
+        return;
+    }
+    if (profile_format.empty() && trace_path.empty())
+    {
+        cout << judge(info, codes) << endl;
+        return;
+    }
+    Game game(info.title, info.in, info.available_command, info.n_playground, info.expected_out, info.max_steps);
+    for (const string &code : codes)
+        game.addCode(code);
+    game.profiling = !profile_format.empty();
+    game.tracing = !trace_path.empty();
+    game.runCode(false);
+    cout << judgeResult(game) << endl;
+    if (game.profiling)
+        cout << game.profile.report(game.program, game.codes, profile_format == "json") << endl;
+    if (game.tracing && !game.trace.save(trace_path))
+        cerr << "cannot write trace to " << trace_path << endl;
+}
+
+// 用于测试代码正确性，无CLI和互动
+// @param option 为--profile或--profile-json时附带性能分析报告，为--trace=<file>时将执行轨迹写入file，为--analyze时附带静态分析结果
+void testing(string option)
+{
+    int level;
+    string line;
+    getline(cin, line);
+    sscanf(line.c_str(), "%d", &level);
+    string profile_format = "";
+    string trace_path = "";
+    if (option == "--profile")
+        profile_format = "text";
+    else if (option == "--profile-json")
+        profile_format = "json";
+    else if (option.compare(0, 8, "--trace=") == 0)
+        trace_path = option.substr(8);
+    // 内置关卡只评测前三关，关卡包中的关卡均可评测
+    int n_level = levelPack != nullptr ? levelPack->size() : 3;
+    if (level > 0 && level <= n_level)
+    {
+        GameInfo info = levelGameInfo(levelCatalog().level(level - 1));
+        simulate(info, profile_format, trace_path, option == "--analyze");
+    }
+}
+
+// 转换关卡的格式，内容有问题时不写出
+// @param from 为builtin时为内置关卡，否则为关卡包文件（二进制或文本格式）
+// @param to 以.txt结尾时写出文本格式，否则写出二进制格式
+bool convertLevels(const string &from, const string &to)
+{
+    LevelCatalog pack;
+    string error;
+    if (from != "builtin" && !pack.open(from, error))
+    {
+        cerr << from << ": " << error << endl;
+        return false;
+    }
+    const LevelCatalog &catalog = from == "builtin" ? builtinCatalog() : pack;
+    vector<string> problems = validateLevels(catalog);
+    for (const string &problem : problems)
+        cerr << from << ": " << problem << endl;
+    if (!problems.empty())
+        return false;
+
+    ofstream out(to, ios::binary);
+    if (to.size() >= 4 && to.compare(to.size() - 4, 4, ".txt") == 0)
+        out << levelText(catalog);
+    else
+        out.write(catalog.data(), catalog.dataSize());
+    if (!out)
+    {
+        cerr << "cannot write " << to << endl;
+        return false;
+    }
+    cout << catalog.size() << " levels written to " << to << endl;
+    return true;
+}
+
+// 检查关卡包，逐行输出发现的问题
+bool checkLevels(const string &path)
+{
+    LevelCatalog pack;
+    string error;
+    if (!pack.open(path, error))
+    {
+        cout << path << ": " << error << endl;
+        return false;
+    }
+    vector<string> problems = validateLevels(pack);
+    for (const string &problem : problems)
+        cout << path << ": " << problem << endl;
+    if (problems.empty())
+        cout << path << ": " << pack.size() << " levels, ok" << endl;
+    return problems.empty();
+}
+
+// 生成的C++程序中的整数数组，空数组补一个0使其合法
+string cppArray(const string &name, const vector<int> &values)
+{
+    string text = "static const int " + name + "[] = {";
+    for (int i = 0; i < values.size(); i++)
+        text += (i > 0 ? ", " : "") + to_string(values[i]);
+    if (values.empty())
+        text += "0";
+    return text + "};\n";
+}
+
+// 生成的C++程序中的字符串字面量，引号、反斜杠与控制字符均转义
+string cppString(const string &text)
+{
+    string literal = "\"";
+    for (unsigned char c : text)
+    {
+        if (c == '"' || c == '\\')
+            literal += string("\\") + (char)c;
+        else if (c < 0x20 || c == 0x7f)
+        {
+            // 三位八进制转义，不会与后面的字符连在一起
+            literal += '\\';
+            literal += (char)('0' + (c >> 6));
+            literal += (char)('0' + (c >> 3 & 7));
+            literal += (char)('0' + (c & 7));
+        }
+        else
+            literal += c;
+    }
+    return literal + "\"";
+}
+
+// 生成的C++程序中的注释内容，控制字符会结束注释、行尾的反斜杠会续行，均替换掉
+string cppComment(string text)
+{
+    for (char &c : text)
+    {
+        if ((unsigned char)c < 0x20 || c == 0x7f)
+            c = ' ';
+        else if (c == '\\')
+            c = '/';
+    }
+    return text;
+}
+
+// 将关卡及其解答翻译为独立的C++程序，运行结果与步数与runCode一致
+// 每行为一个标签，跳转为goto，空地为大小固定的局部数组，死循环检测与LoopDetector相同
+// 生成的程序不带参数时输出评测结果，带参数seconds时反复运行并按bench的格式输出速度
+string generateCpp(const GameInfo &info, const vector<Instruction> &program, const vector<string> &codes, const string &name)
+{
+    int n = program.size();
+    int n_slot = max(info.n_playground, 1);
+    string text;
+    text += "// generated from " + cppComment(name) + " for " + cppComment(info.title) + ", do not edit\n";
+    text += "#include <algorithm>\n#include <chrono>\n#include <cstdio>\n#include <cstdlib>\n#include <string>\n#include <vector>\n\n";
+    // bench中的名字
+    text += "#define CASE_NAME " + cppString(name) + "\n";
+    text += cppArray("kIn", info.in);
+    text += "static const int kInCount = " + to_string(info.in.size()) + ";\n";
+    text += cppArray("kExpected", info.expected_out);
+    text += "static const int kExpectedCount = " + to_string(info.expected_out.size()) + ";\n";
+    text += "static const long long kMaxSteps = " + to_string(info.max_steps) + "LL;\n";
+    text += "static const int kSlots = " + to_string(n_slot) + ";\n\n";
+    text += R"(enum Status { SUCCESS, FAIL, ERROR, TIMEOUT };
+
+struct Result
+{
+    Status status;
+    long long steps;
+    int line; // line of the error, 0 otherwise
+};
+
+// Brent's cycle detection on the machine state at every taken jump, reset by every inbox/outbox
+struct LoopDetector
+{
+    int pc, hand;
+    bool hand_full;
+    int slot[kSlots];
+    bool full[kSlots];
+    long long power, lam;
+
+    void reset()
+    {
+        pc = -1;
+        power = 1;
+        lam = 0;
+    }
+
+    bool seen(int line, int h, bool h_full, const int *s, const bool *f)
+    {
+        if (line == pc && h_full == hand_full && (!h_full || h == hand))
+        {
+            bool same = true;
+            for (int i = 0; i < kSlots && same; i++)
+                same = full[i] == f[i] && slot[i] == s[i];
+            if (same)
+                return true;
+        }
+        if (++lam == power)
+        {
+            pc = line;
+            hand_full = h_full;
+            hand = h_full ? h : 0;
+            for (int i = 0; i < kSlots; i++)
+            {
+                slot[i] = s[i];
+                full[i] = f[i];
+            }
+            power *= 2;
+            lam = 0;
+        }
+        return false;
+    }
+};
+
+static Result run()
+{
+    int slot[kSlots] = {};
+    bool full[kSlots] = {};
+    int hand = 0;
+    bool hand_full = false;
+    long long steps = 0;
+    int in_pos = 0;
+    int n_out = 0;
+    int error_line = 0;
+    LoopDetector loop;
+    loop.reset();
+    (void)slot;
+    (void)full;
+    (void)hand;
+    (void)hand_full;
+    (void)in_pos;
+    (void)error_line;
+
+// each macro is a single statement, so it can follow an if
+#define STEP()                  \
+    do                          \
+    {                           \
+        if (steps == kMaxSteps) \
+            goto timeout;       \
+        steps++;                \
+    } while (0)
+#define FAIL(n)         \
+    do                  \
+    {                   \
+        error_line = n; \
+        goto error;     \
+    } while (0)
+#define JUMP(t)                                            \
+    do                                                     \
+    {                                                      \
+        if (loop.seen(t - 1, hand, hand_full, slot, full)) \
+            goto timeout;                                  \
+        goto L##t;                                         \
+    } while (0)
+
+)";
+    // 只为跳转目标生成标签
+    vector<bool> target(n + 1, false);
+    for (const Instruction &command : program)
+    {
+        if (command.id == CommandId::jump || command.id == CommandId::jumpifzero)
+            target[command.arg] = true;
+    }
+    // 只输出被引用的标签，否则生成的程序有未使用标签的警告
+    bool uses_fail = false, uses_error = n == 0;
+    for (int i = 0; i < n; i++)
+    {
+        const Instruction &command = program[i];
+        uses_fail |= command.id == CommandId::outbox;
+        uses_error |= command.id != CommandId::inbox && command.id != CommandId::jump;
+        string x = to_string(command.arg);
+        string line = to_string(i + 1);
+        string comment = "// " + line + ": " + cppComment(i < codes.size() ? codes[i] : toStr(command.id)) + "\n";
+        text += target[i + 1] ? "L" + line + ": " + comment : comment;
+        text += "    STEP();\n";
+        switch (command.id)
+        {
+        case CommandId::inbox:
+            text += "    if (in_pos == kInCount)\n        goto halt;\n";
+            text += "    hand = kIn[in_pos++];\n    hand_full = true;\n    loop.reset();\n";
+            break;
+        case CommandId::outbox:
+            text += "    if (!hand_full)\n        FAIL(" + line + ");\n";
+            text += "    hand_full = false;\n";
+            text += "    if (n_out >= kExpectedCount || kExpected[n_out] != hand)\n        goto fail;\n";
+            text += "    n_out++;\n    loop.reset();\n";
+            break;
+        case CommandId::add:
+        case CommandId::sub:
+            text += "    if (!hand_full || !full[" + x + "])\n        FAIL(" + line + ");\n";
+            text += "    hand " + string(command.id == CommandId::add ? "+=" : "-=") + " slot[" + x + "];\n";
+            break;
+        case CommandId::copyto:
+            text += "    if (!hand_full)\n        FAIL(" + line + ");\n";
+            text += "    if (full[" + x + "])\n        hand_full = false;\n";
+            text += "    slot[" + x + "] = hand;\n    full[" + x + "] = true;\n";
+            break;
+        case CommandId::copyfrom:
+            text += "    if (!full[" + x + "])\n        FAIL(" + line + ");\n";
+            text += "    hand = slot[" + x + "];\n    hand_full = true;\n";
+            break;
+        case CommandId::jump:
+            text += "    JUMP(" + x + ");\n";
+            break;
+        case CommandId::jumpifzero:
+            text += "    if (!hand_full)\n        FAIL(" + line + ");\n";
+            text += "    if (hand == 0)\n        JUMP(" + x + ");\n";
+            break;
+        default:
+            text += "    FAIL(" + line + ");\n";
+            break;
+        }
+    }
+    // 与其他引擎一致，空程序在第1行出错
+    if (n == 0)
+        text += "    FAIL(1);\n";
+    text += "    goto halt;\n\nhalt:\n    return {n_out == kExpectedCount ? SUCCESS : FAIL, steps, 0};\n";
+    if (uses_fail)
+        text += "fail:\n    return {FAIL, steps, 0};\n";
+    if (uses_error)
+        text += "error:\n    return {ERROR, steps, error_line};\n";
+    // 每行都以STEP开始，只有空程序没有超时
+    if (n > 0)
+        text += "timeout:\n    return {TIMEOUT, steps, 0};\n";
+    text += R"(#undef JUMP
+#undef FAIL
+#undef STEP
+}
+
+static std::string resultText(const Result &r)
+{
+    if (r.status == ERROR)
+        return "Error on instruction " + std::to_string(r.line);
+    if (r.status == FAIL)
+        return "Fail";
+    if (r.status == TIMEOUT)
+        return "Timeout";
+    return "Success";
+}
+
+// usage: checker [seconds], without seconds the result is printed once
+int main(int argc, char *argv[])
+{
+    Result r = run();
+    if (argc < 2)
+    {
+        printf("%s\n", resultText(r).c_str());
+        return 0;
+    }
+    using clock = std::chrono::steady_clock;
+    double min_seconds = atof(argv[1]);
+    std::vector<double> latency;
+    long long runs = 0, steps = 0;
+    double seconds = 0;
+    clock::time_point start = clock::now();
+    while (seconds < min_seconds || runs < 3)
+    {
+        clock::time_point t0 = clock::now();
+        Result again = run();
+        clock::time_point t1 = clock::now();
+        runs++;
+        steps += again.steps;
+        if (latency.size() < (1 << 16))
+            latency.push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+        seconds = std::chrono::duration<double>(t1 - start).count();
+    }
+    std::sort(latency.begin(), latency.end());
+    printf("{\"case\":\"%s\",\"engine\":\"aot\",\"result\":\"%s\",\"runs\":%lld,\"steps_per_run\":%.0f,"
+           "\"steps_per_sec\":%.0f,\"ns_per_step\":%.3f,\"allocs_per_run\":0.00,"
+           "\"p50_us\":%.3f,\"p99_us\":%.3f}\n",
+           CASE_NAME, resultText(r).c_str(), runs, (double)steps / runs, steps / seconds, seconds * 1e9 / steps,
+           latency[latency.size() / 2], latency[std::min(latency.size() - 1, latency.size() * 99 / 100)]);
+    return 0;
+}
+)";
+    return text;
+}
 
-    Game(string title, vector<int> &in, vector<CommandId> &available_command, int n_playground_boxes, list<int> &expected_out)
+// 读取某关卡的解答文件，将生成的C++程序写入output_path，为空时输出到标准输出
+bool emitCpp(int level, string solution_path, string output_path)
+{
+    if (level < 1 || level > levelCatalog().size())
     {
-        this->title = title;
-        for (int i : in)
-        {
-            in_boxes.push_back(i);
-            ori_in.push_back(i);
-        }
-        playground_boxes.resize(n_playground_boxes);
-        this->expected_out = expected_out;
-        this->available_command = available_command;
-        robot_column = 3;
-        current_line = -1;
-        step_delay = STEP_DELAY;
-        logAvailableCommand = true;
-        prevResult = Result::idle;
-        step_used = 0;
-        passed = false;
+        cerr << "no level " << level << endl;
+        return false;
+    }
+    GameInfo info = levelGameInfo(levelCatalog().level(level - 1));
+    Game game(info.title, info.in, info.available_command, info.n_playground, info.expected_out, info.max_steps);
+    if (!game.importCode(solution_path))
+    {
+        cerr << "cannot import code from file " << solution_path << endl;
+        return false;
+    }
+    game.beginCode();
+    string name = solution_path.substr(solution_path.find_last_of("/\\") + 1);
+    name = name.substr(0, name.find('.'));
+    string text = generateCpp(info, game.program, game.codes, name);
+    if (output_path.empty())
+    {
+        cout << text;
+        return true;
     }
+    ofstream out(output_path);
+    out << text;
+    return (bool)out;
+}
 
-    // 刷新屏幕
-    void updateScreen()
+#ifdef ojTest
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// 穷举搜索某关卡行数最少与步数最少的解答，用于确定新关卡的标准成绩
+// 按行数从小到大枚举程序，每行从字母表（关卡允许的指令与其所有合法参数）中选取，用constRun运行，在第一个不符合的输出处即停止
+// 以下程序不是最优的，不运行：
+//   1. 空地编号不按首次出现的顺序：重命名空地得到的程序行为相同，只保留字典序最小的一个，因此各线程之间无需去重表
+//   2. 跳转到本行或下一行，或手中盒子被紧接着的copyfrom/inbox覆盖（copyfrom/add/sub之后）：删去该行结果不变而且更快
+//   3. 含有从第一行出发不可达的行
+//   4. 有期望输出时没有outbox或inbox（手中盒子只能来自输入）
+// 运行只执行到第k行的程序，与只改动第k行之后各行得到的程序结果相同，一并跳过
+// 任务按前两行划分，各线程以原子计数器领取，结果在线程结束后合并
+class Superoptimizer
+{
+public:
+    struct Solution
     {
-        screen.clear();
-        screen.draw(in_boxes, out_boxes, playground_boxes, codes, current_line, robot_column, box_taken);
-        if (logAvailableCommand)
-            screen.drawAvailableCommand(available_command);
-        else
-            screen.drawResultBlock(prevResult, step_used);
-        for (int i = 0; i < 5; i++)
-        {
-            cleanLineAbove();
-        }
-        cout << "\033[H";
-        cout << "Level Information: " << title << endl
-             << endl;
-        screen.print();
-        // print ori in
-        cout << "Ori In: ";
-        for (Box &box : ori_in)
+        int n_lines = 0;
+        long long steps = 0;
+        // 每行在字母表中的序号，结果相同时取字典序最小者，使结果与线程数无关
+        vector<int> choice;
+        vector<Instruction> program;
+
+        bool found() const
         {
-            cout << box.data << " ";
+            return n_lines > 0;
         }
-        cout << endl;
-        // print target output
-        cout << "Expected Out: ";
-        for (int i : expected_out)
+    };
+
+private:
+    ConstLevel level;
+    unsigned commands;
+    long long step_limit;
+
+    // 行数为n_lines时每行可选的指令
+    vector<Instruction> alphabet(int n_lines) const
+    {
+        vector<Instruction> result;
+        for (int id = 0; id < (int)CommandId::invalid; id++)
         {
-            cout << i << " ";
+            if (!(commands & commandBit((CommandId)id)))
+                continue;
+            if ((CommandId)id < CommandId::add)
+                result.push_back({(CommandId)id, 0});
+            else if ((CommandId)id < CommandId::jump)
+            {
+                for (int x = 0; x < level.n_playground; x++)
+                    result.push_back({(CommandId)id, x});
+            }
+            else
+            {
+                for (int x = 1; x <= n_lines; x++)
+                    result.push_back({(CommandId)id, x});
+            }
         }
-        cout << endl;
-        cout << endl;
+        return result;
     }
 
-    // 重置并且运行所有指令
-    // @param animate 是否呈现运行过程动画
-    bool runCode(bool animate)
+    // @return 第一个使程序不可能最优的行，均无问题时返回-1，有不可达的行时返回最后一行
+    int firstRedundantLine(const Instruction *code, int n) const
     {
-        step_used = 0;
-        prevResult = Result::idle;
-        logAvailableCommand = false;
-        current_line = 1;
-        out_boxes.clear();
-        current_out.clear();
-        for (Box &box : playground_boxes)
-            box.empty();
-        box_taken.empty();
-        in_boxes = ori_in;
-        if (codes.size() == 0)
-        {
-            prevResult = Result::error;
-            return false;
-        }
-        bool error = false, done = false;
-        while (true)
+        int next_slot = 0;
+        bool has_inbox = false, has_outbox = false;
+        for (int i = 0; i < n; i++)
         {
-            step_used++;
-            string code = codes[current_line - 1];
-            pair<CommandId, int> command;
-            error = !isValidCommand(code, command);
-            if (error)
-                break;
-            int arg = command.second;
-            switch (command.first)
+            CommandId id = code[i].id;
+            int x = code[i].arg;
+            has_inbox = has_inbox || id == CommandId::inbox;
+            has_outbox = has_outbox || id == CommandId::outbox;
+            if (level.n_out > 0 && !has_inbox + !has_outbox > n - 1 - i)
+                return i;
+            if (id == CommandId::jump || id == CommandId::jumpifzero)
             {
-            case CommandId::inbox:
-                done = !handleInbox(animate);
-                break;
-            case CommandId::outbox:
-                error = !handleOutbox(animate);
-                break;
-            case CommandId::copyto:
-                error = !handleCopyto(arg, animate);
-                break;
-            case CommandId::copyfrom:
-                error = !handleCopyFrom(arg, animate);
-                break;
-            case CommandId::add:
-                error = !handleAdd(arg, animate);
-                break;
-            case CommandId::sub:
-                error = !handleSub(arg, animate);
-                break;
-            case CommandId::jump:
-                error = !handleJump(arg);
-                if (!error)
-                    continue;
-                break;
-            case CommandId::jumpifzero:
-                bool jumped;
-                error = !handleJumpIfZero(arg, jumped);
-                if (jumped)
-                    continue;
-                break;
+                if (x == i + 1 || x == i + 2)
+                    return i;
+            }
+            else if (id >= CommandId::add)
+            {
+                if (x > next_slot)
+                    return i;
+                if (x == next_slot)
+                    next_slot++;
+            }
+            if (i > 0 && (id == CommandId::copyfrom || id == CommandId::inbox))
+            {
+                CommandId prev = code[i - 1].id;
+                if (prev == CommandId::copyfrom || prev == CommandId::add || prev == CommandId::sub)
+                    return i;
             }
-            if (error)
-                break;
-            current_line++;
-            if (current_line > codes.size())
-                done = true;
-            if (done)
-                break;
-        }
-        if (error)
-        {
-            prevResult = Result::error;
-            return false;
-        }
-        current_line = -1;
-        if (resultMatched())
-        {
-            prevResult = Result::success;
-            passed = true;
-            return true;
         }
-        else
+        bool seen[CONST_MAX_CODE] = {true};
+        int stack[CONST_MAX_CODE] = {0};
+        int n_seen = 1, top = 1;
+        while (top > 0)
         {
-            prevResult = Result::failed;
-            return false;
+            int i = stack[--top];
+            int next[2] = {-1, -1};
+            if (code[i].id != CommandId::jump && i + 1 < n)
+                next[0] = i + 1;
+            if (code[i].id == CommandId::jump || code[i].id == CommandId::jumpifzero)
+                next[1] = code[i].arg - 1;
+            for (int j : next)
+            {
+                if (j >= 0 && !seen[j])
+                {
+                    seen[j] = true;
+                    stack[top++] = j;
+                    n_seen++;
+                }
+            }
         }
+        return n_seen == n ? -1 : n - 1;
     }
 
-    // 从file_path文件中加载代码
-    bool importCode(string file_path)
+    // a比b更好：行数或步数更少，相同时取字典序较小者
+    static bool better(const Solution &a, const Solution &b, bool by_steps)
     {
-        ifstream file(file_path);
-        if (!file.is_open())
-        {
+        if (!b.found())
+            return a.found();
+        if (!a.found())
             return false;
-        }
-        string line;
-        int n_command;
-        try
+        if (by_steps && a.steps != b.steps)
+            return a.steps < b.steps;
+        if (a.n_lines != b.n_lines)
+            return a.n_lines < b.n_lines;
+        if (a.steps != b.steps)
+            return a.steps < b.steps;
+        return a.choice < b.choice;
+    }
+
+    // 枚举前缀为第task个组合的所有n_lines行程序
+    // @param budget 运行的最大步数
+    void searchTask(long long task, int n_lines, const vector<Instruction> &letters, long long budget, Solution &shortest, Solution &fastest, long long &n_run)
+    {
+        const int n_letters = letters.size();
+        const int n_prefix = min(2, n_lines);
+        vector<int> digit(n_lines, 0);
+        for (int i = n_prefix - 1; i >= 0; i--)
         {
-            getline(file, line);
-            n_command = stoi(line);
+            digit[i] = task % n_letters;
+            task /= n_letters;
         }
-        catch (...)
+        ConstProgram program{};
+        program.n_code = n_lines;
+        // 将第pos行的序号加一，其后各行归零；前缀之内发生进位时本任务结束
+        auto advance = [&](int pos)
         {
+            for (int i = pos + 1; i < n_lines; i++)
+                digit[i] = 0;
+            for (; pos >= n_prefix; pos--)
+            {
+                if (++digit[pos] < n_letters)
+                    return true;
+                digit[pos] = 0;
+            }
             return false;
-        }
-        codes.clear();
-        while (n_command--)
+        };
+        while (true)
         {
-            getline(file, line);
-            addCode(line);
+            for (int i = 0; i < n_lines; i++)
+                program.code[i] = letters[digit[i]];
+            int bad = firstRedundantLine(program.code, n_lines);
+            if (bad >= 0)
+            {
+                if (!advance(max(bad, n_prefix - 1)))
+                    return;
+                continue;
+            }
+            n_run++;
+            ConstResult result = constRun(level, program, budget);
+            if (result.result == Result::success)
+            {
+                Solution solution;
+                solution.n_lines = n_lines;
+                solution.steps = result.steps;
+                solution.choice = digit;
+                solution.program.assign(program.code, program.code + n_lines);
+                if (better(solution, shortest, false))
+                    shortest = solution;
+                if (better(solution, fastest, true))
+                    fastest = solution;
+            }
+            if (!advance(min(result.reached, n_lines) - 1))
+                return;
         }
-        return true;
-    }
-
-    // 增加一行代码
-    void addCode(string code)
-    {
-        trim(code);
-        codes.push_back(code);
-    }
-
-    // 删除最后一行代码
-    void removeCode()
-    {
-        codes.pop_back();
     }
-};
 
-// 储存所有定义的关卡信息的数组
-vector<GameInfo> levelInfo;
+public:
+    // 一共运行的程序个数
+    long long n_run = 0;
 
-// 带CLI进入关卡页面
-// @return 该关卡是否通关（与之前是否通关无关）
-bool playLevel(string title, vector<int> &in, vector<CommandId> &available_command, int n_playground, list<int> &expected_out, string fname)
-{
-    Game game(title, in, available_command, n_playground, expected_out);
-    if (fname.size() > 0)
-        game.importCode(fname);
-    game.updateScreen();
+    // @param level 由toConstLevel转换的关卡
+    // @param step_limit 每个候选程序的最大执行步数，需要更多步数的解答不会被找到
+    Superoptimizer(const ConstLevel &level, const GameInfo &info, long long step_limit)
+        : level(level), commands(commandMask(info.available_command)), step_limit(step_limit) {}
 
-    while (true)
+    // 搜索不超过max_lines行的程序
+    void search(int max_lines, int n_threads, Solution &shortest, Solution &fastest)
     {
-        game.updateScreen();
-        string line;
-        cout << "Enter the command: ( 'r' for run / 'a' for add / 'i' for import / 'q' for quit ) \n> ";
-        getline(cin, line);
-        if (line.compare("r") == 0)
-            game.runCode(true);
-        else if (line.compare("q") == 0)
-            break;
-        else if (line.compare("a") == 0)
+        max_lines = min(max_lines, CONST_MAX_CODE);
+        n_threads = max(n_threads, 1);
+        for (int n_lines = 1; n_lines <= max_lines; n_lines++)
         {
-            // 手动上传指令模式
-            game.logAvailableCommand = true;
-            while (true)
+            vector<Instruction> letters = alphabet(n_lines);
+            if (letters.empty())
+                return;
+            // 已有解答时只有步数更少的程序才有意义
+            long long budget = fastest.found() ? min(step_limit, fastest.steps - 1) : step_limit;
+            long long n_task = letters.size();
+            if (n_lines > 1)
+                n_task *= letters.size();
+            atomic<long long> next_task(0);
+            vector<Solution> shortests(n_threads, shortest), fastests(n_threads, fastest);
+            vector<long long> runs(n_threads, 0);
+            auto worker = [&](int t)
             {
-                game.updateScreen();
-                cout << "Add Code Mode: (input \'q\' if done, \'d\' for delete, \'c\' for clear)\n> ";
-                int arg = 0;
-                getline(cin, line);
-                if (line.compare("q") == 0)
-                {
-                    game.logAvailableCommand = false;
-                    break;
-                }
-                if (line.compare("d") == 0)
-                {
-                    game.removeCode();
-                    continue;
-                }
-                if (line.compare("c") == 0)
-                {
-                    game.codes.clear();
-                    continue;
-                }
-                game.addCode(line);
-            }
-        }
-        else if (line.compare("i") == 0)
-        {
-            // 从文件加载指令模式
-            game.updateScreen();
-            cout << "Enter the file path: (q to quit)\n> ";
-            string file_path;
-            getline(cin, file_path);
-            if (file_path.compare("q") == 0)
-                continue;
-            bool success = game.importCode(file_path);
-            if (!success)
+                long long task;
+                while ((task = next_task.fetch_add(1, memory_order_relaxed)) < n_task)
+                    searchTask(task, n_lines, letters, budget, shortests[t], fastests[t], runs[t]);
+            };
+            vector<thread> pool;
+            for (int t = 1; t < n_threads; t++)
+                pool.emplace_back(worker, t);
+            worker(0);
+            for (thread &th : pool)
+                th.join();
+            for (int t = 0; t < n_threads; t++)
             {
-                cout << "Cannot import code from file " << file_path << endl;
-                delay(500);
+                n_run += runs[t];
+                if (better(shortests[t], shortest, false))
+                    shortest = shortests[t];
+                if (better(fastests[t], fastest, true))
+                    fastest = fastests[t];
             }
         }
     }
-    return game.passed;
-}
+};
 
-// 将每个游戏是否已通过的信息存入db文件中
-void save2Db()
+// 以importCode的格式打印解答
+void printSolution(const string &name, const Superoptimizer::Solution &solution)
 {
-    ofstream db(dbPath);
-    for (int i = 0; i < levelInfo.size(); i++)
+    cout << "# " << name << ": " << solution.n_lines << " lines, " << solution.steps << " steps" << endl;
+    cout << solution.n_lines << endl;
+    for (const Instruction &command : solution.program)
     {
-        db << levelInfo[i]._done ? 1 : 0;
-        db << "\n";
+        cout << toStr(command.id);
+        if (command.id >= CommandId::add)
+            cout << " " << command.arg;
+        cout << endl;
     }
-    db.flush();
-    db.close();
 }
 
-// 从db文件中加载每个关卡的通关信息
-void loadFromDb()
+bool superoptimize(int level, int max_lines, long long step_limit)
 {
-    ifstream db(dbPath);
-    string line;
-    int i = 0;
-    while (i < levelInfo.size() && getline(db, line))
+    if (level < 1 || level > levelCatalog().size())
     {
-        int n;
-        sscanf(line.c_str(), "%d", &n);
-        levelInfo[i++]._done = n > 0;
+        cerr << "no level " << level << endl;
+        return false;
     }
-    db.close();
-}
-
-// 初始化各个关卡信息
-void initGameInfo()
-{
-    levelInfo.resize(4);
-    levelInfo[0].title = "level 1 - the basic";
-    levelInfo[0].in = {1, 2};
-    levelInfo[0].expected_out = {1, 2};
-    levelInfo[0].available_command = {CommandId::inbox, CommandId::outbox};
-    levelInfo[0].n_playground = 0;
-
-    levelInfo[1].title = "level 2 - tricky part";
-    levelInfo[1].in = {3, 9, 5, 1, -2, -2, 9, -9};
-    levelInfo[1].expected_out = {-6, 6, 4, -4, 0, 0, 18, -18};
-    levelInfo[1].n_playground = 3;
-    levelInfo[1].available_command = {CommandId::inbox, CommandId::outbox, CommandId::add, CommandId::sub, CommandId::copyto, CommandId::copyfrom, CommandId::jump, CommandId::jumpifzero};
-
-    levelInfo[2].title = "level 3 - the twin";
-    levelInfo[2].in = {6, 2, 7, 7, -9, 3, -3, -3};
-    levelInfo[2].expected_out = {7, -3};
-    levelInfo[2].n_playground = 3;
-    levelInfo[2].available_command = {CommandId::inbox, CommandId::outbox, CommandId::add, CommandId::sub, CommandId::copyto, CommandId::copyfrom, CommandId::jump, CommandId::jumpifzero};
-
-    levelInfo[3].title = "level 4 - fib number";
-    levelInfo[3].in = {1};
-    levelInfo[3].expected_out = {1, 1, 2, 3};
-    levelInfo[3].n_playground = 4;
-    levelInfo[3].available_command = {CommandId::inbox, CommandId::outbox, CommandId::add, CommandId::sub, CommandId::copyto, CommandId::copyfrom, CommandId::jump, CommandId::jumpifzero};
-}
-
-// 用于测试代码正确性，无CLI和互动
-void simulate(GameInfo &info)
-{
-    Game game(info.title, info.in, info.available_command, info.n_playground, info.expected_out);
-    string line;
-    int n_op;
-    getline(cin, line);
-    sscanf(line.c_str(), "%d", &n_op);
-    for (int i = 1; i <= n_op; i++)
+    if (max_lines <= 0)
     {
-        getline(cin, line);
-        game.addCode(line);
+        cerr << "max lines must be positive" << endl;
+        return false;
     }
-    game.runCode(false);
-    if (game.prevResult == Result::error)
-        cout << "Error on instruction " << game.current_line << endl;
-    else if (game.prevResult == Result::failed)
-        cout << "Fail" << endl;
+    if (step_limit <= 0)
+    {
+        cerr << "step limit must be positive" << endl;
+        return false;
+    }
+    GameInfo info = levelGameInfo(levelCatalog().level(level - 1));
+    ConstLevel const_level;
+    if (!toConstLevel(info, const_level))
+    {
+        cerr << "level " << level << " is too large to search" << endl;
+        return false;
+    }
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    Superoptimizer optimizer(const_level, info, step_limit);
+    Superoptimizer::Solution shortest, fastest;
+    optimizer.search(max_lines, thread::hardware_concurrency(), shortest, fastest);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "# " << info.title << ": up to " << max_lines << " lines, " << optimizer.n_run << " programs run in " << seconds << "s" << endl;
+    if (!shortest.found())
+    {
+        cout << "# no solution found" << endl;
+        return true;
+    }
+    printSolution("shortest", shortest);
+    if (fastest.steps < shortest.steps)
+        printSolution("fastest", fastest);
     else
-        cout << "Success" << endl;
-}
-
-// 用于测试代码正确性，无CLI和互动
-void testing()
-{
-    int level;
-    string line;
-    getline(cin, line);
-    sscanf(line.c_str(), "%d", &level);
-    if (level > 0 && level < 4)
-        simulate(levelInfo[level - 1]);
+        cout << "# the shortest is also the fastest" << endl;
+    return true;
 }
+#endif
 
 // 检查该关卡是否还没抵达
 bool levelIsLocked(int i)
@@ -1204,11 +5816,10 @@ void playGame()
         if (c == 1 && level <= levelInfo.size() && level > 0 && !levelIsLocked(level - 1))
         {
             clearTerminal();
-            GameInfo &info = levelInfo[level - 1];
-            bool passed = playLevel(info.title, info.in, info.available_command, info.n_playground, info.expected_out, "");
+            bool passed = playLevel(builtinCatalog().level(level - 1), "");
             if (passed)
             {
-                info._done = true;
+                levelInfo[level - 1]._done = true;
                 save2Db();
             }
         }